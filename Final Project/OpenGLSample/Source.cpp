@@ -3,13 +3,28 @@
 #include <GL.glew.h> 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// the texture headers include stb_image.h again for its declarations only
+#undef STB_IMAGE_IMPLEMENTATION
+// counts heap allocations, so per-frame paths such as Mesh::Draw can be checked for them
+#define ALLOCATION_COUNTER_IMPLEMENTATION
+#include "allocation_counter.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "shader_manager.h"
 #include "camera.h"
+#include "light_block.h"
+#include "shader_permutation.h"
+#include "instancing.h"
+#include "mesh.h"
+#include "normal_matrix.h"
+#include "image_flip.h"
+#include "texture_array.h"
+#include "texture_cache.h"
+#include "texture_loader.h"
 
 #include <iostream>
 
@@ -29,6 +44,26 @@ unsigned int loadTexture(const char *path);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// draw the pyramid field with one instanced draw call instead of one draw per pyramid
+bool instancedPyramids = true;
+// the camera flashlight (spot light), toggled with F; while it is off the scene is lit by a
+// shader permutation that has no spot light code at all
+bool flashlight = true;
+// how decoded images are turned bottom-up for OpenGL; IMAGE_FLIP_NONE skips the CPU pass and lets the
+// lighting shaders flip V instead
+ImageFlip textureFlip = IMAGE_FLIP_ROWS;
+// GPU block format for loaded textures (encoded on the loader's workers, a quarter to an eighth of RGBA8);
+// TEXTURE_UNCOMPRESSED uploads RGBA8 (with the mips also built on the workers, see TextureLoader::cpuMipmaps)
+TextureCompression textureCompression = TEXTURE_BC_AUTO;
+// filter for the mip levels built on the CPU; the sinc filters keep distant textures sharper than the box
+MipFilter textureMipFilter = MIP_FILTER_KAISER;
+// time flipImageVertically against the old byte loop on a 4K image before the window opens
+bool benchmarkImageFlipAtStartup = false;
+// milliseconds per frame the render thread may spend uploading textures decoded by TextureLoader
+double textureUploadBudget = 2.0;
+// pack the material textures into texture arrays and atlases (TextureArrayPacker) and draw from those,
+// so switching between their materials binds nothing
+bool textureArrays = true;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 7.0f));
@@ -80,25 +115,6 @@ void main(
 }
 );
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{    
-	for (int j = 0; j < height / 2; ++j)    
-	{        
-		int index1 = j * width * channels;        
-		int index2 = (height - 1 - j) * width * channels;        
-		
-		for (int i = width * channels; i > 0; --i)        
-		{            
-			unsigned char tmp = image[index1];            
-			image[index1] = image[index2];            
-			image[index2] = tmp;            
-			++index1;            
-			++index2;        
-			}    
-		}
-}
-
 // Load texture (relative to project's directory)    
 const char* texFilename = "../../resources/textures/brick.png";    
 if (!UCreateTexture(texFilename, gTextureId))
@@ -161,8 +177,24 @@ struct GLMesh
 	GLuint nVertices;    // Number of indices of the mesh    
 };
 
-int main()
+int main(int argc, char **argv)
 {
+	// bake tool: "OpenGLSample --bake container2.png container2_specular.png ..." writes <image>.gstx next to
+	// each image with the texture settings above, which TextureLoader then maps instead of decoding
+	if (argc > 2 && std::string(argv[1]) == "--bake")
+	{
+		int failed = 0;
+		for (int i = 2; i < argc; i++)
+			if (bakeTexture(argv[i], textureFlip, textureCompression, false, textureMipFilter))
+				std::cout << "baked " << bakedTexturePath(argv[i]) << std::endl;
+			else
+				failed++;
+		return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (benchmarkImageFlipAtStartup)
+		benchmarkImageFlip(std::cout);
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -202,6 +234,8 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	// let the driver compile shaders on its own threads when it supports GL_KHR_parallel_shader_compile
+	ParallelShaderCompile::enable((GLADloadproc)glfwGetProcAddress);
 
 	// configure global opengl state
 	// -----------------------------
@@ -209,8 +243,17 @@ int main()
 
 	// build and compile our shader zprogram
 	// ------------------------------------
-	Shader lightingShader("shaderfiles/6.multiple_lights.vs", "shaderfiles/6.multiple_lights.fs");
-	Shader lightCubeShader("shaderfiles/6.light_cube.vs", "shaderfiles/6.light_cube.fs");
+	// the tiny fallback program is finished right away; the real programs are only submitted here
+	// and the render loop draws with the fallback until each of them reports ready()
+	Shader& fallbackShader = ShaderManager::get().acquire("shaderfiles/fallback.vs", "shaderfiles/fallback.fs");
+	const unsigned int lightingTextures = textureFeatures(textureFlip, textureArrays);
+	const LightingPermutation fullLighting = { FULL_LIGHTING.features | lightingTextures, NR_POINT_LIGHTS };
+	Shader& lightingShader = ShaderManager::get().acquire("shaderfiles/6.multiple_lights.vs", "shaderfiles/6.multiple_lights.fs", fullLighting, COMPILE_ASYNC);
+	const LightingPermutation noFlashlight = { LIGHTING_DIRECTIONAL | lightingTextures, NR_POINT_LIGHTS };
+	Shader& noFlashlightShader = ShaderManager::get().acquire("shaderfiles/6.multiple_lights.vs", "shaderfiles/6.multiple_lights.fs", noFlashlight, COMPILE_ASYNC);
+	Shader& lightCubeShader = ShaderManager::get().acquire("shaderfiles/6.light_cube.vs", "shaderfiles/6.light_cube.fs", nullptr, COMPILE_ASYNC);
+	// saving a file under shaderfiles/ rebuilds the programs that use it at the start of the next frame
+	ShaderManager::get().enableHotReload();
 
 	// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 	void UProcessInput(GLFWwindow* window)
@@ -439,10 +482,41 @@ void UCreateMesh(GLMesh &mesh)
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 
+	// the pyramid transforms never change, so compute them once; the instanced path keeps them in a
+	// per-instance vertex buffer attached to the pyramid VAO
+	std::vector<glm::mat4> pyramidTransforms;
+	for (unsigned int i = 0; i < sizeof(pyramidPositions) / sizeof(pyramidPositions[0]); i++)
+	{
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, pyramidPositions[i]);
+		float angle = 20.0f * i;
+		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+		pyramidTransforms.push_back(model);
+	}
+	InstanceBuffer pyramidInstances;
+	pyramidInstances.upload(pyramidTransforms);
+	pyramidInstances.attach(cubeVAO);
+
 	// load textures (we now use a utility function to keep the code more organized)
 	// -----------------------------------------------------------------------------
 	//unsigned int diffuseMap = loadTexture("container2.png");
 	//unsigned int specularMap = loadTexture("container2_specular.png");
+	// with textureArrays the material set is packed up front into shared arrays, and meshes (or instances)
+	// only pass their layers and UV rects
+	TextureArrayPacker materialTextures;
+	TextureRegion diffuseRegion, specularRegion;
+	if (textureArrays)
+	{
+		TextureOptions options;
+		options.flip = textureFlip;
+		options.compression = textureCompression;
+		options.mipFilter = textureMipFilter;
+		size_t diffuseImage = materialTextures.add("container2.png", options);
+		size_t specularImage = materialTextures.add("container2_specular.png", options);
+		materialTextures.build();
+		diffuseRegion = materialTextures.region(diffuseImage);
+		specularRegion = materialTextures.region(specularImage);
+	}
 
 	void UDestroyMesh(GLMesh &mesh)
 {
@@ -450,12 +524,47 @@ void UCreateMesh(GLMesh &mesh)
     glDeleteBuffers(2, mesh.vbos);
 }
 
-	// shader configuration
-	// --------------------
-	lightingShader.use();
-	lightingShader.setInt("material.diffuse", 0);
-	lightingShader.setInt("material.specular", 1);
-
+	// all lights live in one uniform buffer shared by every lit program
+	LightBuffer lightBuffer;
+	LightBlock &lights = lightBuffer.lights;
+	// directional light (Added directional lighting to enhance graphics)
+	lights.dirLight.direction = glm::vec3(-0.1f, 1.0f, -0.3f);
+	lights.dirLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+	lights.dirLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+	lights.dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+	// point lights
+	for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+	{
+		lights.pointLights[i].position = pointLightPositions[i];
+		lights.pointLights[i].ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+		lights.pointLights[i].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+		lights.pointLights[i].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+		lights.pointLights[i].constant = 1.0f;
+		lights.pointLights[i].linear = 0.09f;
+		lights.pointLights[i].quadratic = 0.032f;
+	}
+	// Added specular lighting from the left direction
+	lights.pointLights[0].specular = glm::vec3(-2.0f, 1.0f, 1.0f);
+	// Added Diffuse lighting and ambient lighting
+	lights.pointLights[1].ambient = glm::vec3(1.05f, 0.05f, 0.05f);
+	lights.pointLights[1].diffuse = glm::vec3(1.8f, 0.8f, 0.8f);
+	lights.pointLights[1].specular = glm::vec3(-2.0f, 1.0f, 1.0f);
+	// Point light 3 has added matrices to enhance the lighting direction
+	lights.pointLights[2].linear = 0.13f;
+	lights.pointLights[2].constant = -2.0f;
+	// spotLight
+	lights.spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+	lights.spotLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+	lights.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	lights.spotLight.constant = 1.0f;
+	lights.spotLight.linear = 0.09f;
+	lights.spotLight.quadratic = 0.032f;
+	lights.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+	lights.spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+
+	// shader configuration happens once each lighting permutation is ready, and again after every hot reload
+	Shader* lightingVariants[] = { &lightingShader, &noFlashlightShader };
+	long long lightingConfiguredGeneration[] = { -1, -1 };
 
 	// render loop
 	// -----------
@@ -471,130 +580,101 @@ void UCreateMesh(GLMesh &mesh)
 		// -----
 		processInput(window);
 
+		// pick up edited shader files before anything is drawn with them
+		ShaderManager::get().update();
+		// swap finished decodes in for their placeholders
+		TextureLoader::get().update(textureUploadBudget);
+
 		// render
 		// ------
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// shader configuration
+		// --------------------
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			Shader &variant = *lightingVariants[i];
+			if (!variant.ready() || lightingConfiguredGeneration[i] == variant.generation)
+				continue;
+			variant.use();
+			variant.setInt("material.diffuse", 0);
+			variant.setInt("material.specular", 1);
+			lightBuffer.attach(variant);
+			lightingConfiguredGeneration[i] = variant.generation;
+		}
+		// the cheapest permutation that still covers every active light
+		Shader &litShader = flashlight ? lightingShader : noFlashlightShader;
+		// draw with the fallback program while the real ones are still compiling
+		Shader &sceneShader = litShader.ready() ? litShader : fallbackShader;
+		Shader &lampShader = lightCubeShader.ready() ? lightCubeShader : fallbackShader;
+		// resolve the per-object uniforms once per frame; the object loops reuse the handles
+		UniformHandle sceneModel = sceneShader.uniform("model");
+		UniformHandle sceneNormalMatrix = sceneShader.uniform("normalMatrix");
+		UniformHandle sceneInstanced = sceneShader.uniform("instanced");
+		UniformHandle lampModel = lampShader.uniform("model");
+
 		// be sure to activate shader when setting uniforms/drawing objects
-		lightingShader.use();
-		lightingShader.setVec3("viewPos", camera.Position);
-		lightingShader.setFloat("material.shininess", 32.0f);
-
-		/*
-		   Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
-		   the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-		   by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-		   by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-		*/
-		// directional light
-		lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-		lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-		lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-		// Added Directional lighting to enhance graphics
-		lightingShader.setVec3("dirLight.direction", -0.1f, 1.0f, -0.3f);
-		lightingShader.setVec3("dirLight.direction", -0.1f, 1.0f, -0.3f);
-		lightingShader.setVec3("dirLight.direction", -0.1f, 1.0f, -0.3f);
-		
-		// point light 1
-		lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-		lightingShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("pointLights[0].constant", 1.0f);
-		lightingShader.setFloat("pointLights[0].linear", 0.09);
-		lightingShader.setFloat("pointLights[0].quadratic", 0.032);
-		// Added specular lighting from the left direction
-		lightingShader.setVec3("pointLights[0].specular", -2.0f, 1.0f, 1.0f);
-		lightingShader.setVec3("pointLights[0].specular", -2.0f, 1.0f, 1.0f);
-		
-		// point light 2
-		lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-		lightingShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("pointLights[1].constant", 1.0f);
-		lightingShader.setFloat("pointLights[1].linear", 0.09);
-		lightingShader.setFloat("pointLights[1].quadratic", 0.032);
-		// Added Diffuse lighting and ambient lighting
-		lightingShader.setVec3("pointLights[1].diffuse", 1.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[1].diffuse", 1.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[1].diffuse", 1.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[1].ambient", 2.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[1].ambient", 2.05f, 0.05f, 0.05f);
-		
-		// point light 3
-		lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-		lightingShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("pointLights[2].constant", 1.0f);
-		lightingShader.setFloat("pointLights[2].linear", 0.09);
-		lightingShader.setFloat("pointLights[2].quadratic", 0.032);
-		// Point light 3 has added matrices to enhance the lighting direction
-		lightingShader.setFloat("pointLights[2].linear", 0.13);
-		lightingShader.setFloat("pointLights[2].constant", -2.0f);
-		lightingShader.setVec3("pointLights[1].ambient", 1.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[1].diffuse", 1.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[1].specular", -2.0f, 1.0f, 1.0f);
-		
-		// point light 4
-		lightingShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-		lightingShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("pointLights[3].constant", 1.0f);
-		lightingShader.setFloat("pointLights[3].linear", 0.09);
-		lightingShader.setFloat("pointLights[3].quadratic", 0.032);
-		
-		// spotLight
-		lightingShader.setVec3("spotLight.position", camera.Position);
-		lightingShader.setVec3("spotLight.direction", camera.Front);
-		lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-		lightingShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("spotLight.constant", 1.0f);
-		lightingShader.setFloat("spotLight.linear", 0.09);
-		lightingShader.setFloat("spotLight.quadratic", 0.032);
-		lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+		sceneShader.use();
+		sceneShader.setVec3("viewPos", camera.Position);
+		sceneShader.setFloat("material.shininess", 32.0f);
+
+		// only the spotlight follows the camera; the rest of the rig was filled in once before the loop,
+		// and the light buffer skips the upload entirely on frames where nothing moved
+		lightBuffer.lights.spotLight.position = camera.Position;
+		lightBuffer.lights.spotLight.direction = camera.Front;
+		lightBuffer.upload();
 
 		// view/projection transformations
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
+		sceneShader.setMat4("projection", projection);
+		sceneShader.setMat4("view", view);
 
 		// world transformation
 		glm::mat4 model = glm::mat4(1.0f);
-		lightingShader.setMat4("model", model);
+		sceneShader.setMat4(sceneModel, model);
+		sceneShader.setMat3(sceneNormalMatrix, normalMatrix(model));
 
-		// bind diffuse map
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap);
-		// bind specular map
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap);
+		if (textureArrays)
+		{
+			GLState::get().bindTexture(0, GL_TEXTURE_2D_ARRAY, diffuseRegion.texture);
+			GLState::get().bindTexture(1, GL_TEXTURE_2D_ARRAY, specularRegion.texture);
+			// the whole field shares one material, so its regions are constant attributes
+			setMaterialRegions(materialRegions(diffuseRegion, specularRegion));
+		}
+		else
+		{
+			// bind diffuse map
+			GLState::get().bindTexture(0, GL_TEXTURE_2D, diffuseMap);
+			// bind specular map
+			GLState::get().bindTexture(1, GL_TEXTURE_2D, specularMap);
+		}
 
-		// render containers
+		// render pyramids
 		glBindVertexArray(cubeVAO);
-		for (unsigned int i = 0; i < 10; i++)
+		sceneShader.setBool(sceneInstanced, instancedPyramids);
+		if (instancedPyramids)
 		{
-			// calculate the model matrix for each object and pass it to shader before drawing
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[i]);
-			float angle = 20.0f * i;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			lightingShader.setMat4("model", model);
-
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+			// every pyramid reads its model matrix from the instance buffer: one draw for the whole field
+			pyramidInstances.drawArrays(GL_TRIANGLES, 0, 36);
+		}
+		else
+		{
+			for (unsigned int i = 0; i < pyramidTransforms.size(); i++)
+			{
+				// pass each object's model and normal matrix to the shader before drawing
+				sceneShader.setMat4(sceneModel, pyramidTransforms[i]);
+				sceneShader.setMat3(sceneNormalMatrix, normalMatrix(pyramidTransforms[i]));
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+			}
 		}
 
 		// also draw the lamp object(s)
-		lightCubeShader.use();
-		lightCubeShader.setMat4("projection", projection);
-		lightCubeShader.setMat4("view", view);
+		lampShader.use();
+		lampShader.setMat4("projection", projection);
+		lampShader.setMat4("view", view);
+		lampShader.setBool("instanced", false);
 
 		// we now draw as many light bulbs as we have point lights.
 		glBindVertexArray(lightCubeVAO);
@@ -603,7 +683,7 @@ void UCreateMesh(GLMesh &mesh)
 			model = glm::mat4(1.0f);
 			model = glm::translate(model, pointLightPositions[i]);
 			model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-			lightCubeShader.setMat4("model", model);
+			lampShader.setMat4(lampModel, model);
 			glDrawArrays(GL_TRIANGLES, 0, 36);
 		}
 
@@ -614,11 +694,29 @@ void UCreateMesh(GLMesh &mesh)
 		glfwPollEvents();
 	}
 
+	// report how many redundant GL calls the state cache dropped, and which uniforms caused them
+	GLState::get().printStats(std::cout);
+	lightingShader.printRedundantUniforms(std::cout);
+	noFlashlightShader.printRedundantUniforms(std::cout);
+	lightCubeShader.printRedundantUniforms(std::cout);
+	fallbackShader.printRedundantUniforms(std::cout);
+	ShaderManager::get().printStats(std::cout);
+	TextureLoader::get().printStats(std::cout);
+	TextureCache::get().printStats(std::cout);
+	materialTextures.printStats(std::cout);
+	std::cout << "Mesh::Draw steady-state allocations: " << Mesh::steadyStateAllocations() << std::endl;
+
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
 	glDeleteVertexArrays(1, &cubeVAO);
 	glDeleteVertexArrays(1, &lightCubeVAO);
 	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &pyramidInstances.VBO);
+	glDeleteBuffers(1, &lightBuffer.UBO);
+	ShaderManager::get().clear();
+	materialTextures.clear();
+	TextureCache::get().clear();
+	TextureLoader::get().clear();
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
@@ -641,6 +739,13 @@ void processInput(GLFWwindow *window)
 		camera.ProcessKeyboard(LEFT, deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		camera.ProcessKeyboard(RIGHT, deltaTime);
+
+	// toggle on the press, not every frame the key is held
+	static bool flashlightKeyDown = false;
+	bool flashlightKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+	if (flashlightKey && !flashlightKeyDown)
+		flashlight = !flashlight;
+	flashlightKeyDown = flashlightKey;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -868,113 +973,54 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 		}
 
 	/*Generate and load the texture*/
+	// Textures come from the TextureCache, so a file already in use is shared rather than decoded again. A
+	// new one is decoded on TextureLoader's worker threads and shows a placeholder until the render loop
+	// uploads it. Only the header is read here, to reject missing or unsupported files.
 	bool UCreateTexture(const char* filename, GLuint& textureId)
-	{    
-		int width, height, channels;    
-		unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);    
-		if (image)    
-		{        
-			flipImageVertically(image, width, height, channels);        
-			
-			glGenTextures(1, &textureId);        
-			glBindTexture(GL_TEXTURE_2D, textureId);       
-			
-			// set the texture wrapping parameters        
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);        
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);        
-			
-			// set texture filtering parameters        
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);        
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);        
-			
-			if (channels == 3)            
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);        
-			
-			else if (channels == 4)            
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);        
-			
-			else        
-			{
-				cout << "Not implemented to handle image with " << channels << " channels" << endl;            
-				return false;        
-			}        
-			
-			glGenerateMipmap(GL_TEXTURE_2D);        
-			
-			stbi_image_free(image);        
-			glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture        
-			return true;    
-			}    
-			
-			// Error loading the image    
-			return false;
-			}
+	{
+		TextureOptions options;
+		options.flip = textureFlip;
+		options.compression = textureCompression;
+		options.mipFilter = textureMipFilter;
+		textureId = TextureCache::get().acquire(filename, options);
+		return textureId != 0;
+	}
+
+	// utility function for loading a 2D texture from file; the returned id is usable at once (see TextureLoader)
+	// and is shared through the TextureCache
+	// ---------------------------------------------------------------------------------------------------------
+	unsigned int loadTexture(char const * path)
+	{
+		TextureOptions options;
+		options.flip = textureFlip;
+		options.compression = textureCompression;
+		options.mipFilter = textureMipFilter;
+		return TextureCache::get().acquire(path, options);
+	}
 			
+			// drops this user's reference; the texture is deleted once nothing else holds it
 			void UDestroyTexture(GLuint textureId)
 			{    
-				glGenTextures(1, &textureId);
+				TextureCache::get().release(textureId);
 			}
 			
 			// Implements the UCreateShaders function
+			// programs are owned by the ShaderManager, so identical sources are compiled only once and shared
 			bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
 			{    
-				// Compilation and linkage error reporting    
-				int success = 0
-				char infoLog[512];    
-				
-				// Create a Shader program object.    
-				programId = glCreateProgram();    
-				
-				// Create the vertex and fragment shader objects    
-				GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);    
-				GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);    
-				
-				// Retrive the shader source    
-				glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);    
-				glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);    
-				
-				// Compile the vertex shader, and print compilation errors (if any)    
-				glCompileShader(vertexShaderId); // compile the vertex shader    
-				// check for shader compile errors    
-				glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);    
-				if (!success)    
-				{        
-					glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);        
-					std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;        
-					
-					return false;    
-				}    
-				
-				glCompileShader(fragmentShaderId); // compile the fragment shader    
-				// check for shader compile errors    
-				glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);    
-				if 
-				{        
-					glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);        
-					std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;        
-					
-					return false;    
-				}    
-				
-				// Attached compiled shaders to the shader program    
-				glAttachShader(programId, vertexShaderId);    
-				glAttachShader(programId, fragmentShaderId);    
-				glLinkProgram(programId);   // links the shader program    
-				
-				// check for linking errors    
-				glGetProgramiv(programId, GL_LINK_STATUS, &success);    
-				if (!success)    
-				{        
-					glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);        
-					std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;        
-					return false;    
-				}    
+				Shader& shader = ShaderManager::get().acquireSource(vtxShaderSource, fragShaderSource);
+				programId = shader.ID;
+				if (!shader.ready())
+				{
+					ShaderManager::get().release(programId);
+					return false;
+				}
 				
-				glUseProgram(programId);    // Uses the shader program    
+				shader.use();    // Uses the shader program    
 				return true;
 				}
 				
-				void UDestroyShaderProgram(GLuint programId)(!success)
+				void UDestroyShaderProgram(GLuint programId)
 				{    
-					glDeleteProgram(programId);
+					ShaderManager::get().release(programId);
 				}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts calls to the global operator new, to check that hot paths such as Mesh::Draw stay allocation free.
+// The count is per thread, so texture and shader workers allocating in the background do not show up in
+// a difference taken around a render thread call.
+// Like stb_image, define ALLOCATION_COUNTER_IMPLEMENTATION in exactly one .cpp before including this
+// header to install the counting operators; without it count() stays at zero.
+class AllocationCounter
+{
+public:
+	// allocations made so far by the calling thread
+	static unsigned long long count()
+	{
+		return counter();
+	}
+
+	static void record()
+	{
+		counter()++;
+	}
+
+private:
+	// constant-initialized, so it is safe to use from operator new before main and on any thread
+	static unsigned long long &counter()
+	{
+		static thread_local unsigned long long allocations = 0;
+		return allocations;
+	}
+};
+
+#ifdef ALLOCATION_COUNTER_IMPLEMENTATION
+void *operator new(std::size_t size)
+{
+	AllocationCounter::record();
+	void *memory = std::malloc(size ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+void operator delete[](void *memory) noexcept
+{
+	std::free(memory);
+}
+void operator delete(void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+void operator delete[](void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+#endif
+#endif
\ No newline at end of file
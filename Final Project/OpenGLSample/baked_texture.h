@@ -0,0 +1,269 @@
+#ifndef BAKED_TEXTURE_H
+#define BAKED_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "block_compression.h"
+#include "image_flip.h"
+#include "mapped_file.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Baked texture container ("GSTX"), in the spirit of KTX2: every mip level already in the format the GPU
+// takes, so loading is mmap + validate + upload straight from the mapping, with no decode and no mip pass:
+//
+//   BakedTextureHeader
+//   level table     levelCount BakedTextureLevel, largest level first
+//   level data      each level's blocks (or RGBA8 rows), tightly packed
+//
+// Levels start on 16 byte boundaries. Files are little-endian and written by bakeTexture, next to the
+// source image as <image>.gstx (bakedTexturePath).
+const unsigned int BAKED_TEXTURE_MAGIC = 0x58545347; // "GSTX"
+const unsigned int BAKED_TEXTURE_VERSION = 1;
+
+enum BakedTextureFlags {
+	BAKED_TEXTURE_SRGB = 1,
+	// rows run bottom-up, i.e. the image was flipped for OpenGL when it was baked
+	BAKED_TEXTURE_BOTTOM_UP = 2
+};
+
+struct BakedTextureHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	// TextureCompression, never TEXTURE_BC_AUTO; TEXTURE_UNCOMPRESSED levels are RGBA8
+	unsigned int compression;
+	// GL internal format of every level; open() checks it against the one compression and the sRGB flag
+	// give, and the loader only ever uses that derived format
+	unsigned int internalFormat;
+	unsigned int width;
+	unsigned int height;
+	// channel count of the source image, which decides what TEXTURE_BC_AUTO means
+	unsigned int channels;
+	unsigned int levelCount;
+	unsigned int flags;
+	// MipFilter the levels were made with (0, the box, in files from before it was recorded)
+	unsigned int mipFilter;
+	// byte offset of the level table from the start of the file
+	unsigned long long levelOffset;
+};
+
+struct BakedTextureLevel
+{
+	unsigned int width;
+	unsigned int height;
+	// byte offsets from the start of the file
+	unsigned long long offset;
+	unsigned long long size;
+};
+
+static_assert(sizeof(BakedTextureHeader) == 48, "BakedTextureHeader is part of the file format");
+static_assert(sizeof(BakedTextureLevel) == 24, "BakedTextureLevel is part of the file format");
+
+inline std::string bakedTexturePath(const std::string &image)
+{
+	return image + ".gstx";
+}
+
+// A validated view of a mapped baked texture; data() and levels stay valid while it is open.
+class BakedTextureFile
+{
+public:
+	const BakedTextureHeader *header = nullptr;
+	// what the levels are uploaded as, derived from the header's compression and sRGB flag
+	GLenum internalFormat = 0;
+	// offsets relative to data()
+	std::vector<CompressedLevel> levels;
+
+	// false without a message when the file does not exist
+	bool open(const char *path)
+	{
+		header = nullptr;
+		internalFormat = 0;
+		levels.clear();
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(BakedTextureHeader))
+			return fail(path, "truncated header");
+		const BakedTextureHeader *candidate = (const BakedTextureHeader*)file.data();
+		if (candidate->magic != BAKED_TEXTURE_MAGIC || candidate->version != BAKED_TEXTURE_VERSION)
+			return fail(path, "not a baked texture of this version");
+		if (candidate->compression > TEXTURE_BC5 || candidate->compression == TEXTURE_BC_AUTO || candidate->channels == 0 || candidate->channels > 4
+			|| candidate->levelCount == 0 || candidate->levelCount > 32)
+			return fail(path, "bad format");
+		TextureCompression compression = (TextureCompression)candidate->compression;
+		bool srgb = (candidate->flags & BAKED_TEXTURE_SRGB) != 0;
+		// the same choice bakeImage made: uncompressedMipImage only stores colour images as sRGB
+		GLenum format = compression == TEXTURE_UNCOMPRESSED ? (srgb && candidate->channels >= 3 ? GL_SRGB8_ALPHA8 : GL_RGBA8)
+			: compressedFormat(compression, srgb);
+		if (candidate->internalFormat != format)
+			return fail(path, "internal format does not match the compression");
+		if (!inside(candidate->levelOffset, (unsigned long long)candidate->levelCount * sizeof(BakedTextureLevel)))
+			return fail(path, "level table outside the file");
+		if (candidate->levelOffset % alignof(BakedTextureLevel) != 0)
+			return fail(path, "misaligned level table");
+
+		const BakedTextureLevel *table = (const BakedTextureLevel*)(file.data() + candidate->levelOffset);
+		unsigned int width = candidate->width, height = candidate->height;
+		for (unsigned int l = 0; l < candidate->levelCount; l++)
+		{
+			const BakedTextureLevel &level = table[l];
+			// a mip chain starts at the image size and halves down, or the texture is incomplete
+			if (level.width != width || level.height != height)
+				return fail(path, "levels are not a mip chain");
+			width = std::max(1u, width / 2);
+			height = std::max(1u, height / 2);
+			unsigned long long expected = compression == TEXTURE_UNCOMPRESSED ? (unsigned long long)level.width * level.height * 4
+				: (unsigned long long)((level.width + 3) / 4) * ((level.height + 3) / 4) * compressedBlockBytes(compression);
+			if (level.width == 0 || level.height == 0 || level.size != expected || !inside(level.offset, level.size))
+				return fail(path, "level outside the file");
+			CompressedLevel info;
+			info.width = (int)level.width;
+			info.height = (int)level.height;
+			info.offset = (size_t)level.offset;
+			info.size = (size_t)level.size;
+			levels.push_back(info);
+		}
+		header = candidate;
+		internalFormat = format;
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		header = nullptr;
+		internalFormat = 0;
+		levels.clear();
+	}
+
+	const unsigned char *data() const { return file.data(); }
+	size_t size() const { return file.size(); }
+
+	// whether this file is what loading the source image with these settings would produce
+	bool matches(ImageFlip flip, TextureCompression compression, bool srgb, MipFilter filter) const
+	{
+		bool bottomUp = flip != IMAGE_FLIP_NONE;
+		return header != nullptr && (unsigned int)resolveCompression(compression, (int)header->channels) == header->compression
+			&& ((header->flags & BAKED_TEXTURE_BOTTOM_UP) != 0) == bottomUp && ((header->flags & BAKED_TEXTURE_SRGB) != 0) == srgb
+			&& header->mipFilter == (unsigned int)filter;
+	}
+
+private:
+	MappedFile file;
+
+	bool inside(unsigned long long offset, unsigned long long length) const
+	{
+		return offset <= file.size() && length <= file.size() - offset;
+	}
+
+	bool fail(const char *path, const char *reason)
+	{
+		std::cout << "ERROR::BAKED_TEXTURE::" << reason << ": " << path << std::endl;
+		close();
+		return false;
+	}
+};
+
+// The baked file for an image if it exists, is not older than the image and was made with these settings;
+// null otherwise. Safe to call from any thread.
+inline std::shared_ptr<BakedTextureFile> openBakedTexture(const std::string &image, ImageFlip flip, TextureCompression compression, bool srgb,
+	MipFilter filter)
+{
+	std::string bakedPath = bakedTexturePath(image);
+	long long bakedTime = fileModifiedTime(bakedPath);
+	if (bakedTime == 0 || bakedTime < fileModifiedTime(image))
+		return std::shared_ptr<BakedTextureFile>();
+	std::shared_ptr<BakedTextureFile> baked(new BakedTextureFile());
+	if (!baked->open(bakedPath.c_str()) || !baked->matches(flip, compression, srgb, filter))
+		return std::shared_ptr<BakedTextureFile>();
+	return baked;
+}
+
+// every level of an image in its upload format; TEXTURE_UNCOMPRESSED gives RGBA8 levels
+inline CompressedImage bakeImage(const unsigned char *pixels, int width, int height, int channels, TextureCompression compression, bool srgb,
+	MipFilter filter)
+{
+	compression = resolveCompression(compression, channels);
+	if (compression != TEXTURE_UNCOMPRESSED)
+		return compressImage(pixels, width, height, channels, compression, srgb, filter);
+	return uncompressedMipImage(pixels, width, height, channels, srgb, filter);
+}
+
+// ------------------------------------------------------------------------
+inline bool writeBakedTexture(const char *path, const CompressedImage &image, int channels, bool bottomUp, bool srgb, MipFilter filter)
+{
+	BakedTextureHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = BAKED_TEXTURE_MAGIC;
+	header.version = BAKED_TEXTURE_VERSION;
+	header.compression = image.compression;
+	header.internalFormat = image.format;
+	header.width = (unsigned int)image.levels[0].width;
+	header.height = (unsigned int)image.levels[0].height;
+	header.channels = (unsigned int)channels;
+	header.levelCount = (unsigned int)image.levels.size();
+	header.flags = (srgb ? BAKED_TEXTURE_SRGB : 0) | (bottomUp ? BAKED_TEXTURE_BOTTOM_UP : 0);
+	header.mipFilter = (unsigned int)filter;
+	header.levelOffset = sizeof(BakedTextureHeader);
+
+	std::vector<BakedTextureLevel> table(image.levels.size());
+	unsigned long long offset = (header.levelOffset + table.size() * sizeof(BakedTextureLevel) + 15) & ~15ull;
+	for (size_t l = 0; l < table.size(); l++)
+	{
+		table[l].width = (unsigned int)image.levels[l].width;
+		table[l].height = (unsigned int)image.levels[l].height;
+		table[l].offset = offset;
+		table[l].size = image.levels[l].size;
+		offset = (offset + table[l].size + 15) & ~15ull;
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	const char padding[16] = { 0 };
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)table.data(), (std::streamsize)(table.size() * sizeof(BakedTextureLevel)));
+	unsigned long long written = sizeof(header) + table.size() * sizeof(BakedTextureLevel);
+	for (size_t l = 0; l < table.size(); l++)
+	{
+		file.write(padding, (std::streamsize)(table[l].offset - written));
+		file.write((const char*)&image.data[image.levels[l].offset], (std::streamsize)table[l].size);
+		written = table[l].offset + table[l].size;
+	}
+	return file.good();
+}
+
+// Bake tool: decodes an image the way TextureLoader would with these settings and writes
+// bakedTexturePath(image) next to it. Runs the encoder on ThreadPool::shared(), so call it from outside
+// the pool.
+inline bool bakeTexture(const char *image, ImageFlip flip, TextureCompression compression, bool srgb, MipFilter filter = MIP_FILTER_BOX)
+{
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load_thread(flip == IMAGE_FLIP_IN_DECODER);
+	unsigned char *pixels = stbi_load(image, &width, &height, &channels, 0);
+	if (pixels == nullptr)
+	{
+		std::cout << "ERROR::BAKED_TEXTURE::cannot read " << image << " (" << stbi_failure_reason() << ")" << std::endl;
+		return false;
+	}
+	if (flip == IMAGE_FLIP_ROWS)
+		flipImageVertically(pixels, width, height, channels);
+	CompressedImage baked = bakeImage(pixels, width, height, channels, compression, srgb, filter);
+	stbi_image_free(pixels);
+	std::string path = bakedTexturePath(image);
+	if (!writeBakedTexture(path.c_str(), baked, channels, flip != IMAGE_FLIP_NONE, srgb, filter))
+	{
+		std::cout << "ERROR::BAKED_TEXTURE::cannot write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+#endif
\ No newline at end of file
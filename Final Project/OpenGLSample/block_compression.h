@@ -0,0 +1,479 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "mip_generator.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// SSE2 is the x86 baseline, so the vector encoders need no /arch switch
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_COMPRESSION_SIMD
+#include <emmintrin.h>
+#endif
+
+// S3TC comes from EXT_texture_compression_s3tc (and EXT_texture_sRGB for the sRGB forms), which every
+// desktop driver exposes but glad was not generated with; RGTC (BC4/BC5) is core since 3.0
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// GPU block formats; every one stores 4x4 texel blocks
+enum TextureCompression {
+	TEXTURE_UNCOMPRESSED,
+	// chosen from the decoded channel count: BC1 for grey and colour, BC3 for grey + alpha and colour + alpha
+	// (BC4/BC5 would sample grey as red only); only ever picks S3TC formats
+	TEXTURE_BC_AUTO,
+	// opaque colour, 8 bytes per block
+	TEXTURE_BC1,
+	// colour with alpha, 16 bytes per block
+	TEXTURE_BC3,
+	// one channel (red), 8 bytes per block
+	TEXTURE_BC4,
+	// two channels (red, green), e.g. normal map XY, 16 bytes per block
+	TEXTURE_BC5
+};
+
+inline TextureCompression resolveCompression(TextureCompression compression, int channels)
+{
+	if (compression != TEXTURE_BC_AUTO)
+		return compression;
+	static const TextureCompression byChannels[5] = { TEXTURE_BC1, TEXTURE_BC1, TEXTURE_BC3, TEXTURE_BC1, TEXTURE_BC3 };
+	return byChannels[std::min(std::max(channels, 0), 4)];
+}
+
+// The compression the current context can take. S3TC (BC1/BC3, and so TEXTURE_BC_AUTO) is an extension,
+// its sRGB forms need EXT_texture_sRGB as well; without them the texture is stored uncompressed. The
+// answer is looked up once, so the first call has to come from the thread owning the context.
+inline TextureCompression supportedCompression(TextureCompression compression, bool srgb)
+{
+	static const bool s3tc = hasGLExtension("GL_EXT_texture_compression_s3tc");
+	static const bool s3tcSrgb = s3tc && hasGLExtension("GL_EXT_texture_sRGB");
+	bool needsS3tc = compression == TEXTURE_BC_AUTO || compression == TEXTURE_BC1 || compression == TEXTURE_BC3;
+	if (needsS3tc && !(srgb ? s3tcSrgb : s3tc))
+		return TEXTURE_UNCOMPRESSED;
+	return compression;
+}
+
+inline size_t compressedBlockBytes(TextureCompression compression)
+{
+	return compression == TEXTURE_BC1 || compression == TEXTURE_BC4 ? 8 : 16;
+}
+
+inline GLenum compressedFormat(TextureCompression compression, bool srgb)
+{
+	switch (compression)
+	{
+	case TEXTURE_BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEXTURE_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TEXTURE_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case TEXTURE_BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return 0;
+	}
+}
+
+// size of a full mip chain in a (resolved) block format
+inline size_t compressedImageBytes(int width, int height, TextureCompression compression)
+{
+	size_t bytes = 0;
+	for (;;)
+	{
+		bytes += (size_t)((width + 3) / 4) * ((height + 3) / 4) * compressedBlockBytes(compression);
+		if (width == 1 && height == 1)
+			return bytes;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+}
+
+struct CompressedLevel
+{
+	int width = 0;
+	int height = 0;
+	// into CompressedImage::data
+	size_t offset = 0;
+	size_t size = 0;
+};
+
+// every mip level of one texture, blocks stored level after level; format is the GL internal format
+// (with TEXTURE_UNCOMPRESSED, as bakeImage produces, the levels are RGBA8 rows instead of blocks)
+struct CompressedImage
+{
+	TextureCompression compression = TEXTURE_UNCOMPRESSED;
+	GLenum format = 0;
+	std::vector<CompressedLevel> levels;
+	std::vector<unsigned char> data;
+};
+
+// The encoders take one 4x4 block as 16 RGBA pixels, row by row. Endpoints are a range fit (per-channel
+// bounding box, inset by 1/16 for colour) and each texel gets the palette entry nearest to its projection
+// onto the endpoint axis. That is the quality of the usual real-time encoders, not of a cluster fit.
+// ------------------------------------------------------------------------
+inline unsigned short packRgb565(int r, int g, int b)
+{
+	return (unsigned short)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+inline void unpackRgb565(unsigned short color, int rgb[3])
+{
+	int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Turns the block's colour bounds into the two BC1 endpoints (c0 >= c1, so the 4-colour palette) and
+// writes them. Returns false for a flat block, which then needs no indices.
+inline bool writeBc1Endpoints(int low[3], int high[3], unsigned char *out, int first[3], int second[3])
+{
+	for (int c = 0; c < 3; c++)
+	{
+		int inset = (high[c] - low[c]) >> 4;
+		low[c] += inset;
+		high[c] -= inset;
+	}
+	unsigned short c0 = packRgb565(high[0], high[1], high[2]);
+	unsigned short c1 = packRgb565(low[0], low[1], low[2]);
+	out[0] = (unsigned char)c0;
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)c1;
+	out[3] = (unsigned char)(c1 >> 8);
+	std::memset(out + 4, 0, 4);
+	unpackRgb565(c0, first);
+	unpackRgb565(c1, second);
+	return c0 != c1;
+}
+
+// t is a texel's position between the endpoints, 0 at the low end and 3 (BC1) or 7 (BC4) at the high end;
+// the formats order their palettes high, low, then the blends from the high end
+inline unsigned int bc1Index(int t)
+{
+	return ((4 - t) & 3) ^ (((t + 1) >> 1 & 1) ^ 1);
+}
+
+inline unsigned int bc4Index(int t)
+{
+	return ((8 - t) & 7) ^ (((t + 1) & 6) == 0 ? 1 : 0);
+}
+
+inline void writeBc4Indices(const int t[16], unsigned char *out)
+{
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned long long)bc4Index(t[i]) << (3 * i);
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// reference encoders; the SSE2 ones below give the same bytes
+// ------------------------------------------------------------------------
+inline void encodeBc1Scalar(const unsigned char *block, unsigned char *out)
+{
+	int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+	for (int p = 0; p < 16; p++)
+		for (int c = 0; c < 3; c++)
+		{
+			low[c] = std::min(low[c], (int)block[p * 4 + c]);
+			high[c] = std::max(high[c], (int)block[p * 4 + c]);
+		}
+	int first[3], second[3];
+	if (!writeBc1Endpoints(low, high, out, first, second))
+		return;
+	float axis[3] = { (float)(first[0] - second[0]), (float)(first[1] - second[1]), (float)(first[2] - second[2]) };
+	float scale = 3.0f / (axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	unsigned int bits = 0;
+	for (int p = 0; p < 16; p++)
+	{
+		float d = ((float)block[p * 4] - (float)second[0]) * axis[0] + ((float)block[p * 4 + 1] - (float)second[1]) * axis[1]
+			+ ((float)block[p * 4 + 2] - (float)second[2]) * axis[2];
+		int t = (int)std::nearbyint(std::min(std::max(d * scale, 0.0f), 3.0f));
+		bits |= bc1Index(t) << (2 * p);
+	}
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+inline void encodeBc4Scalar(const unsigned char *block, int channel, unsigned char *out)
+{
+	int low = 255, high = 0;
+	for (int p = 0; p < 16; p++)
+	{
+		low = std::min(low, (int)block[p * 4 + channel]);
+		high = std::max(high, (int)block[p * 4 + channel]);
+	}
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+	std::memset(out + 2, 0, 6);
+	if (low == high)
+		return;
+	float scale = 7.0f / (float)(high - low);
+	int t[16];
+	for (int p = 0; p < 16; p++)
+		t[p] = (int)std::nearbyint((float)(block[p * 4 + channel] - low) * scale);
+	writeBc4Indices(t, out);
+}
+
+#ifdef BLOCK_COMPRESSION_SIMD
+// ------------------------------------------------------------------------
+inline void encodeBc1Sse2(const unsigned char *block, unsigned char *out)
+{
+	__m128i rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = _mm_loadu_si128((const __m128i*)(block + 16 * r));
+	__m128i low = _mm_min_epu8(_mm_min_epu8(rows[0], rows[1]), _mm_min_epu8(rows[2], rows[3]));
+	__m128i high = _mm_max_epu8(_mm_max_epu8(rows[0], rows[1]), _mm_max_epu8(rows[2], rows[3]));
+	low = _mm_min_epu8(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+	low = _mm_min_epu8(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+	high = _mm_max_epu8(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+	high = _mm_max_epu8(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+	int lowBits = _mm_cvtsi128_si32(low), highBits = _mm_cvtsi128_si32(high);
+	int lows[3], highs[3];
+	for (int c = 0; c < 3; c++)
+	{
+		lows[c] = (lowBits >> (8 * c)) & 255;
+		highs[c] = (highBits >> (8 * c)) & 255;
+	}
+	int first[3], second[3];
+	if (!writeBc1Endpoints(lows, highs, out, first, second))
+		return;
+
+	const __m128 axisR = _mm_set1_ps((float)(first[0] - second[0]));
+	const __m128 axisG = _mm_set1_ps((float)(first[1] - second[1]));
+	const __m128 axisB = _mm_set1_ps((float)(first[2] - second[2]));
+	float lengthSquared = (float)(first[0] - second[0]) * (float)(first[0] - second[0]) + (float)(first[1] - second[1]) * (float)(first[1] - second[1])
+		+ (float)(first[2] - second[2]) * (float)(first[2] - second[2]);
+	const __m128 scale = _mm_set1_ps(3.0f / lengthSquared);
+	const __m128 originR = _mm_set1_ps((float)second[0]);
+	const __m128 originG = _mm_set1_ps((float)second[1]);
+	const __m128 originB = _mm_set1_ps((float)second[2]);
+	const __m128i byteMask = _mm_set1_epi32(255);
+	const __m128i one = _mm_set1_epi32(1), three = _mm_set1_epi32(3), four = _mm_set1_epi32(4);
+	unsigned int bits = 0;
+	for (int r = 0; r < 4; r++)
+	{
+		__m128 red = _mm_cvtepi32_ps(_mm_and_si128(rows[r], byteMask));
+		__m128 green = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rows[r], 8), byteMask));
+		__m128 blue = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rows[r], 16), byteMask));
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(red, originR), axisR), _mm_mul_ps(_mm_sub_ps(green, originG), axisG)),
+			_mm_mul_ps(_mm_sub_ps(blue, originB), axisB));
+		__m128i t = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(d, scale), _mm_setzero_ps()), _mm_set1_ps(3.0f)));
+		// bc1Index, four texels at a time
+		__m128i ends = _mm_xor_si128(_mm_and_si128(_mm_srli_epi32(_mm_add_epi32(t, one), 1), one), one);
+		__m128i index = _mm_xor_si128(_mm_and_si128(_mm_sub_epi32(four, t), three), ends);
+		int indices[4];
+		_mm_storeu_si128((__m128i*)indices, index);
+		bits |= (unsigned int)(indices[0] | indices[1] << 2 | indices[2] << 4 | indices[3] << 6) << (8 * r);
+	}
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// ------------------------------------------------------------------------
+inline void encodeBc4Sse2(const unsigned char *block, int channel, unsigned char *out)
+{
+	const __m128i byteMask = _mm_set1_epi32(255);
+	const __m128i shift = _mm_cvtsi32_si128(8 * channel);
+	__m128i values[4];
+	for (int r = 0; r < 4; r++)
+		values[r] = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)(block + 16 * r)), shift), byteMask);
+	// the values fit in the low 16 bits of each lane, so the 16-bit min/max are exact
+	__m128i low = _mm_min_epi16(_mm_min_epi16(values[0], values[1]), _mm_min_epi16(values[2], values[3]));
+	__m128i high = _mm_max_epi16(_mm_max_epi16(values[0], values[1]), _mm_max_epi16(values[2], values[3]));
+	low = _mm_min_epi16(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+	low = _mm_min_epi16(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+	high = _mm_max_epi16(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+	high = _mm_max_epi16(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+	int lowValue = _mm_cvtsi128_si32(low), highValue = _mm_cvtsi128_si32(high);
+	out[0] = (unsigned char)highValue;
+	out[1] = (unsigned char)lowValue;
+	std::memset(out + 2, 0, 6);
+	if (lowValue == highValue)
+		return;
+	const __m128 scale = _mm_set1_ps(7.0f / (float)(highValue - lowValue));
+	int t[16];
+	for (int r = 0; r < 4; r++)
+		_mm_storeu_si128((__m128i*)(t + 4 * r), _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(values[r], low)), scale)));
+	writeBc4Indices(t, out);
+}
+#endif
+
+inline void encodeBc1(const unsigned char *block, unsigned char *out)
+{
+#ifdef BLOCK_COMPRESSION_SIMD
+	encodeBc1Sse2(block, out);
+#else
+	encodeBc1Scalar(block, out);
+#endif
+}
+
+inline void encodeBc4(const unsigned char *block, int channel, unsigned char *out)
+{
+#ifdef BLOCK_COMPRESSION_SIMD
+	encodeBc4Sse2(block, channel, out);
+#else
+	encodeBc4Scalar(block, channel, out);
+#endif
+}
+
+inline void encodeBlock(TextureCompression compression, const unsigned char *block, unsigned char *out)
+{
+	switch (compression)
+	{
+	case TEXTURE_BC1: encodeBc1(block, out); break;
+	case TEXTURE_BC3: encodeBc4(block, 3, out); encodeBc1(block, out + 8); break;
+	case TEXTURE_BC4: encodeBc4(block, 0, out); break;
+	case TEXTURE_BC5: encodeBc4(block, 0, out); encodeBc4(block, 1, out + 8); break;
+	default: break;
+	}
+}
+
+// copies the 4x4 block at (blockX, blockY), repeating the edge texels where it hangs over the image
+inline void fetchBlock(const unsigned char *rgba, int width, int height, int blockX, int blockY, unsigned char block[64])
+{
+	int x = blockX * 4, y = blockY * 4;
+	if (x + 4 <= width && y + 4 <= height)
+	{
+		for (int r = 0; r < 4; r++)
+			std::memcpy(block + 16 * r, rgba + ((size_t)(y + r) * width + x) * 4, 16);
+		return;
+	}
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			std::memcpy(block + 16 * r + 4 * c, rgba + ((size_t)std::min(y + r, height - 1) * width + std::min(x + c, width - 1)) * 4, 4);
+}
+
+// every level of an image as RGBA8 rows, in the CompressedImage layout so it uploads and bakes like the
+// block formats; mips are filtered on the calling thread
+inline CompressedImage uncompressedMipImage(const unsigned char *pixels, int width, int height, int channels, bool srgb, MipFilter filter)
+{
+	// like the decoded upload, only colour images are stored as sRGB
+	srgb = srgb && channels >= 3;
+	CompressedImage image;
+	image.compression = TEXTURE_UNCOMPRESSED;
+	image.format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	std::vector<std::vector<unsigned char> > mips = buildRgbaMipChain(pixels, width, height, channels, srgb, filter);
+	for (size_t l = 0; l < mips.size(); l++)
+	{
+		CompressedLevel level;
+		level.width = width;
+		level.height = height;
+		level.offset = image.data.size();
+		level.size = mips[l].size();
+		image.levels.push_back(level);
+		image.data.insert(image.data.end(), mips[l].begin(), mips[l].end());
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return image;
+}
+
+// One image's whole mip chain, split into chunks of block rows that encode independently. A pool task can
+// hand the chunks to the same pool and let whichever finishes last pass the result on, so no task ever
+// waits on another (see ThreadPool).
+class BlockCompressionJob
+{
+public:
+	CompressedImage image;
+
+	// pixels are stb's (1-4 channels); the mips are filtered here on the calling thread
+	BlockCompressionJob(const unsigned char *pixels, int width, int height, int channels, TextureCompression compression, bool srgb,
+		MipFilter filter = MIP_FILTER_BOX)
+	{
+		compression = resolveCompression(compression, channels);
+		image.compression = compression;
+		image.format = compressedFormat(compression, srgb);
+		// BC4/BC5 have no sRGB form, so their channels are filtered as plain data
+		mips = buildRgbaMipChain(pixels, width, height, channels, srgb && (compression == TEXTURE_BC1 || compression == TEXTURE_BC3), filter);
+
+		size_t offset = 0;
+		for (size_t l = 0; l < mips.size(); l++)
+		{
+			CompressedLevel info;
+			info.width = width;
+			info.height = height;
+			info.offset = offset;
+			int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+			info.size = (size_t)blocksX * blocksY * compressedBlockBytes(compression);
+			offset += info.size;
+			// about 4096 blocks (a 256x256 texel area) per chunk
+			int rowsPerChunk = std::max(1, 4096 / blocksX);
+			for (int row = 0; row < blocksY; row += rowsPerChunk)
+			{
+				Chunk chunk = { (int)image.levels.size(), row, std::min(blocksY, row + rowsPerChunk) };
+				chunks.push_back(chunk);
+			}
+			image.levels.push_back(info);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		image.data.resize(offset);
+		remaining.store(chunks.size());
+	}
+
+	size_t chunkCount() const
+	{
+		return chunks.size();
+	}
+
+	// true for the call that finished the last outstanding chunk; image is complete from then on
+	// ------------------------------------------------------------------------
+	bool encodeChunk(size_t index)
+	{
+		const Chunk &chunk = chunks[index];
+		const CompressedLevel &level = image.levels[chunk.level];
+		const unsigned char *rgba = mips[chunk.level].data();
+		size_t blockBytes = compressedBlockBytes(image.compression);
+		int blocksX = (level.width + 3) / 4;
+		unsigned char block[64];
+		for (int y = chunk.firstRow; y < chunk.endRow; y++)
+		{
+			unsigned char *out = &image.data[level.offset + (size_t)y * blocksX * blockBytes];
+			for (int x = 0; x < blocksX; x++, out += blockBytes)
+			{
+				fetchBlock(rgba, level.width, level.height, x, y, block);
+				encodeBlock(image.compression, block, out);
+			}
+		}
+		return remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+	}
+
+private:
+	struct Chunk
+	{
+		int level;
+		int firstRow;
+		int endRow;
+	};
+
+	std::vector<std::vector<unsigned char> > mips;
+	std::vector<Chunk> chunks;
+	std::atomic<size_t> remaining;
+};
+
+// Encodes an image and its mips on ThreadPool::shared() and waits for it; for tools and loaders that run
+// outside the pool (pool tasks use BlockCompressionJob directly)
+inline CompressedImage compressImage(const unsigned char *pixels, int width, int height, int channels, TextureCompression compression, bool srgb,
+	MipFilter filter = MIP_FILTER_BOX)
+{
+	BlockCompressionJob job(pixels, width, height, channels, compression, srgb, filter);
+	ThreadPool::shared().parallelFor(job.chunkCount(), [&job](size_t chunk) { job.encodeChunk(chunk); });
+	return std::move(job.image);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef CANONICAL_PATH_H
+#define CANONICAL_PATH_H
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Same file, different spellings ("./a/../b.png", "b.png", "B.PNG" on Windows) map to one cache key
+// (TextureCache, ShaderManager): the absolute path with forward slashes, lower-cased on Windows. Paths that
+// cannot be resolved (the file is missing) are only normalized lexically.
+inline std::string canonicalPath(const char *path)
+{
+	std::string canonical;
+#ifdef _WIN32
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, path, _MAX_PATH) != nullptr)
+		canonical = resolved;
+#else
+	char resolved[PATH_MAX];
+	if (realpath(path, resolved) != nullptr)
+		canonical = resolved;
+#endif
+	if (canonical.empty())
+		canonical = path;
+	std::replace(canonical.begin(), canonical.end(), '\\', '/');
+#ifdef _WIN32
+	std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+#endif
+	std::vector<std::string> parts;
+	size_t start = 0;
+	while (start <= canonical.size())
+	{
+		size_t end = std::min(canonical.find('/', start), canonical.size());
+		std::string part = canonical.substr(start, end - start);
+		if (part == ".." && !parts.empty() && parts.back() != ".." && !parts.back().empty())
+			parts.pop_back();
+		else if (part != "." && (part != "" || parts.empty()))
+			parts.push_back(part);
+		start = end + 1;
+	}
+	std::string joined;
+	for (size_t i = 0; i < parts.size(); i++)
+		joined += (i ? "/" : "") + parts[i];
+	return joined;
+}
+#endif
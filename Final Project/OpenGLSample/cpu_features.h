@@ -0,0 +1,35 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// SSE2 is the x86 baseline; AVX2 code is compiled per function (CPU_AVX2_TARGET) and picked at run time
+// with cpuHasAvx2, so the project needs no /arch switch
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_FEATURES_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CPU_AVX2_TARGET
+#else
+#define CPU_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+// ------------------------------------------------------------------------
+inline bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	// AVX needs the OS to save the YMM registers too (OSXSAVE + XCR0 bits 1 and 2)
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+#endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+
+// Counts every program bind, uniform upload and texture bind that went through the state cache,
+// together with how many of them were dropped because the driver already had that value
+struct GLStateStats
+{
+	unsigned int programBinds = 0;
+	unsigned int programBindsFiltered = 0;
+	unsigned int uniformUploads = 0;
+	unsigned int uniformUploadsFiltered = 0;
+	unsigned int textureBinds = 0;
+	unsigned int textureBindsFiltered = 0;
+	unsigned int activeTextureCalls = 0;
+	unsigned int activeTextureCallsFiltered = 0;
+};
+
+// Last value uploaded to one uniform location; large enough for a mat4
+struct UniformShadow
+{
+	unsigned char value[16 * sizeof(float)];
+	bool valid = false;
+	// how many uploads of the same value this uniform has seen
+	unsigned int redundant = 0;
+};
+
+// is a GL extension exposed by the current context? Walks the core indexed list, so call it during setup
+// rather than per frame
+inline bool hasGLExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// A shadow copy of the GL binding state. Shader::use, Shader::set* and Mesh::Draw go through it so
+// calls that would not change anything never reach the driver. Anything that touches the same state
+// with raw GL calls must call invalidate() afterwards, or the shadow will drop calls it should not.
+class GLState
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+	GLStateStats stats;
+
+	// the one state cache for the current context
+	static GLState &get()
+	{
+		static GLState state;
+		return state;
+	}
+
+	// bind a program unless it is already current
+	// ------------------------------------------------------------------------
+	void useProgram(GLuint program)
+	{
+		stats.programBinds++;
+		if (programValid && currentProgram == program)
+		{
+			stats.programBindsFiltered++;
+			return;
+		}
+		glUseProgram(program);
+		currentProgram = program;
+		programValid = true;
+	}
+	// select a texture unit (0-based) unless it is already active
+	// ------------------------------------------------------------------------
+	void activeTexture(unsigned int unit)
+	{
+		stats.activeTextureCalls++;
+		if (activeUnitValid && activeUnit == unit)
+		{
+			stats.activeTextureCallsFiltered++;
+			return;
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+		activeUnitValid = true;
+	}
+	// bind a texture to a unit; the unit is only switched when the bind is actually issued
+	// ------------------------------------------------------------------------
+	void bindTexture(unsigned int unit, GLenum target, GLuint texture)
+	{
+		stats.textureBinds++;
+		int slot = targetSlot(target);
+		if (unit < MAX_TEXTURE_UNITS && slot >= 0)
+		{
+			TextureBinding &binding = boundTextures[unit][slot];
+			if (binding.valid && binding.texture == texture)
+			{
+				stats.textureBindsFiltered++;
+				return;
+			}
+			binding.texture = texture;
+			binding.valid = true;
+		}
+		activeTexture(unit);
+		glBindTexture(target, texture);
+	}
+	// returns true when value differs from the shadow (and records it), false when the upload is redundant
+	// ------------------------------------------------------------------------
+	bool uniformChanged(UniformShadow &shadow, const void *value, size_t bytes)
+	{
+		stats.uniformUploads++;
+		if (shadow.valid && std::memcmp(shadow.value, value, bytes) == 0)
+		{
+			stats.uniformUploadsFiltered++;
+			shadow.redundant++;
+			return false;
+		}
+		std::memcpy(shadow.value, value, bytes);
+		shadow.valid = true;
+		return true;
+	}
+	// forget all shadowed bindings, e.g. after raw GL calls or a context change
+	// ------------------------------------------------------------------------
+	void invalidate()
+	{
+		programValid = false;
+		activeUnitValid = false;
+		for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+			for (unsigned int slot = 0; slot < TARGET_SLOTS; slot++)
+				boundTextures[unit][slot].valid = false;
+	}
+	// the shadow must not keep a deleted name, since GL may hand it out again
+	// ------------------------------------------------------------------------
+	void forgetProgram(GLuint program)
+	{
+		if (currentProgram == program)
+			programValid = false;
+	}
+	void forgetTexture(GLuint texture)
+	{
+		for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+			for (unsigned int slot = 0; slot < TARGET_SLOTS; slot++)
+				if (boundTextures[unit][slot].texture == texture)
+					boundTextures[unit][slot].valid = false;
+	}
+	// ------------------------------------------------------------------------
+	void resetStats()
+	{
+		stats = GLStateStats();
+	}
+	// ------------------------------------------------------------------------
+	void printStats(std::ostream &out) const
+	{
+		out << "GL state cache (filtered / requested)" << std::endl;
+		out << "  program binds:   " << stats.programBindsFiltered << " / " << stats.programBinds << std::endl;
+		out << "  uniform uploads: " << stats.uniformUploadsFiltered << " / " << stats.uniformUploads << std::endl;
+		out << "  texture binds:   " << stats.textureBindsFiltered << " / " << stats.textureBinds << std::endl;
+		out << "  active texture:  " << stats.activeTextureCallsFiltered << " / " << stats.activeTextureCalls << std::endl;
+	}
+
+private:
+	static const unsigned int TARGET_SLOTS = 3;
+
+	struct TextureBinding
+	{
+		GLuint texture = 0;
+		bool valid = false;
+	};
+
+	GLuint currentProgram = 0;
+	bool programValid = false;
+	unsigned int activeUnit = 0;
+	bool activeUnitValid = false;
+	TextureBinding boundTextures[MAX_TEXTURE_UNITS][TARGET_SLOTS];
+
+	GLState() {}
+	GLState(const GLState &) = delete;
+	GLState &operator=(const GLState &) = delete;
+
+	// only the targets this project binds are shadowed; anything else always reaches the driver
+	static int targetSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_2D_ARRAY: return 1;
+		case GL_TEXTURE_CUBE_MAP: return 2;
+		default: return -1;
+		}
+	}
+};
+#endif
\ No newline at end of file
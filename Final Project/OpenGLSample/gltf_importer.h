@@ -0,0 +1,442 @@
+#ifndef GLTF_IMPORTER_H
+#define GLTF_IMPORTER_H
+
+#include <glm/glm.hpp>
+
+#include "imported_mesh.h"
+#include "json.h"
+#include "mapped_file.h"
+#include "normal_matrix.h"
+#include "thread_pool.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// glTF 2.0, both .gltf (JSON with external or base64 buffers) and .glb. The scene graph is walked once on
+// the calling thread; every (node, primitive) pair is then decoded on its own task with the node's world
+// transform baked into the vertices, since Mesh has no transform of its own.
+// Not supported: sparse accessors, non-triangle primitive modes, images embedded in buffer views.
+class GltfImporter
+{
+public:
+	bool import(const char *path, std::vector<ImportedMesh> &meshes)
+	{
+		this->path = path;
+		directory = directoryOf(path);
+		if (!file.open(path))
+			return fail("cannot open");
+
+		const char *json = (const char*)file.data();
+		size_t jsonSize = file.size();
+		const unsigned char *binary = nullptr;
+		size_t binarySize = 0;
+		if (file.size() >= 12 && std::memcmp(file.data(), "glTF", 4) == 0)
+		{
+			// GLB: 12 byte header, a JSON chunk, then an optional BIN chunk
+			if (readU32(file.data() + 4) != 2 || file.size() < 20)
+				return fail("unsupported GLB version");
+			size_t offset = 12;
+			unsigned int chunkLength = readU32(file.data() + offset);
+			if (readU32(file.data() + offset + 4) != 0x4e4f534a || chunkLength > file.size() - offset - 8)
+				return fail("missing JSON chunk");
+			json = (const char*)file.data() + offset + 8;
+			jsonSize = chunkLength;
+			offset += 8 + ((chunkLength + 3) & ~3u);
+			if (offset + 8 <= file.size() && readU32(file.data() + offset + 4) == 0x004e4942)
+			{
+				binarySize = readU32(file.data() + offset);
+				if (binarySize > file.size() - offset - 8)
+					return fail("truncated BIN chunk");
+				binary = file.data() + offset + 8;
+			}
+		}
+
+		std::string error;
+		if (!JsonValue::parse(json, json + jsonSize, document, error))
+			return fail(error.c_str());
+		if (!loadBuffers(binary, binarySize))
+			return false;
+
+		collectPrimitives();
+		size_t firstMesh = meshes.size();
+		meshes.resize(firstMesh + jobs.size());
+		std::vector<char> decoded(jobs.size(), 0);
+		ThreadPool::shared().parallelFor(jobs.size(), [&](size_t i)
+		{
+			decoded[i] = decodePrimitive(jobs[i], meshes[firstMesh + i]);
+		});
+
+		// drop the primitives that failed to decode
+		size_t kept = firstMesh;
+		for (size_t i = 0; i < jobs.size(); i++)
+			if (decoded[i])
+			{
+				if (kept != firstMesh + i)
+					meshes[kept] = std::move(meshes[firstMesh + i]);
+				kept++;
+			}
+		meshes.resize(kept);
+		if (kept - firstMesh != jobs.size())
+			std::cout << "ERROR::GLTF::skipped " << jobs.size() - (kept - firstMesh) << " primitives: " << path << std::endl;
+		return true;
+	}
+
+private:
+	struct Buffer
+	{
+		const unsigned char *data;
+		size_t size;
+	};
+
+	struct PrimitiveJob
+	{
+		const JsonValue *mesh;
+		const JsonValue *primitive;
+		glm::mat4 world;
+	};
+
+	std::string path;
+	std::string directory;
+	MappedFile file;
+	JsonValue document;
+	std::vector<Buffer> buffers;
+	// storage for external .bin files and decoded data URIs
+	std::vector<std::unique_ptr<MappedFile> > externalFiles;
+	std::vector<std::vector<unsigned char> > decodedUris;
+	std::vector<PrimitiveJob> jobs;
+
+	static unsigned int readU32(const unsigned char *bytes)
+	{
+		return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+	}
+
+	bool fail(const char *reason) const
+	{
+		std::cout << "ERROR::GLTF::" << reason << ": " << path << std::endl;
+		return false;
+	}
+
+	static bool decodeBase64(const char *text, const char *end, std::vector<unsigned char> &out)
+	{
+		unsigned int bits = 0;
+		int bitCount = 0;
+		for (; text < end && *text != '='; text++)
+		{
+			char c = *text;
+			int value;
+			if (c >= 'A' && c <= 'Z') value = c - 'A';
+			else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') value = c - '0' + 52;
+			else if (c == '+' || c == '-') value = 62;
+			else if (c == '/' || c == '_') value = 63;
+			else return false;
+			bits = (bits << 6) | (unsigned int)value;
+			bitCount += 6;
+			if (bitCount >= 8)
+			{
+				bitCount -= 8;
+				out.push_back((unsigned char)(bits >> bitCount));
+			}
+		}
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	bool loadBuffers(const unsigned char *binary, size_t binarySize)
+	{
+		const JsonValue &list = document["buffers"];
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			const std::string &uri = list[i]["uri"].asString();
+			size_t declared = (size_t)list[i]["byteLength"].asNumber();
+			Buffer buffer = { nullptr, 0 };
+			if (uri.empty())
+			{
+				// the GLB's own BIN chunk
+				buffer.data = binary;
+				buffer.size = binarySize;
+			}
+			else if (uri.compare(0, 5, "data:") == 0)
+			{
+				size_t comma = uri.find(";base64,");
+				decodedUris.push_back(std::vector<unsigned char>());
+				if (comma == std::string::npos || !decodeBase64(uri.c_str() + comma + 8, uri.c_str() + uri.size(), decodedUris.back()))
+					return fail("bad data URI");
+				buffer.data = decodedUris.back().data();
+				buffer.size = decodedUris.back().size();
+			}
+			else
+			{
+				externalFiles.push_back(std::unique_ptr<MappedFile>(new MappedFile()));
+				if (!externalFiles.back()->open((directory + uri).c_str()))
+					return fail(("missing buffer " + uri).c_str());
+				buffer.data = externalFiles.back()->data();
+				buffer.size = externalFiles.back()->size();
+			}
+			if (buffer.data == nullptr || buffer.size < declared)
+				return fail("buffer smaller than its byteLength");
+			buffers.push_back(buffer);
+		}
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	static glm::mat4 localTransform(const JsonValue &node)
+	{
+		glm::mat4 transform(1.0f);
+		const JsonValue &matrix = node["matrix"];
+		if (matrix.size() == 16)
+		{
+			for (int column = 0; column < 4; column++)
+				for (int row = 0; row < 4; row++)
+					transform[column][row] = (float)matrix[column * 4 + row].asNumber();
+			return transform;
+		}
+		const JsonValue &t = node["translation"];
+		const JsonValue &r = node["rotation"];
+		const JsonValue &s = node["scale"];
+		float x = (float)r[0].asNumber(), y = (float)r[1].asNumber(), z = (float)r[2].asNumber(), w = (float)r[3].asNumber(1.0);
+		glm::vec3 scale((float)s[0].asNumber(1.0), (float)s[1].asNumber(1.0), (float)s[2].asNumber(1.0));
+		// T * R * S with R from the unit quaternion (x, y, z, w)
+		transform[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f) * scale.x;
+		transform[1] = glm::vec4(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f) * scale.y;
+		transform[2] = glm::vec4(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f) * scale.z;
+		transform[3] = glm::vec4((float)t[0].asNumber(), (float)t[1].asNumber(), (float)t[2].asNumber(), 1.0f);
+		return transform;
+	}
+
+	void visitNode(int index, const glm::mat4 &parent, int depth)
+	{
+		const JsonValue &node = document["nodes"][(size_t)index];
+		if (node.isNull() || depth > 64)
+			return;
+		glm::mat4 world = parent * localTransform(node);
+		const JsonValue &mesh = document["meshes"][(size_t)node["mesh"].asInt()];
+		const JsonValue &primitives = mesh["primitives"];
+		for (size_t p = 0; p < primitives.size(); p++)
+		{
+			PrimitiveJob job = { &mesh, &primitives[p], world };
+			jobs.push_back(job);
+		}
+		const JsonValue &children = node["children"];
+		for (size_t c = 0; c < children.size(); c++)
+			visitNode(children[c].asInt(), world, depth + 1);
+	}
+
+	void collectPrimitives()
+	{
+		const JsonValue &scenes = document["scenes"];
+		if (scenes.size() == 0)
+		{
+			// no scene graph: every mesh once, untransformed
+			const JsonValue &meshes = document["meshes"];
+			for (size_t m = 0; m < meshes.size(); m++)
+				for (size_t p = 0; p < meshes[m]["primitives"].size(); p++)
+				{
+					PrimitiveJob job = { &meshes[m], &meshes[m]["primitives"][p], glm::mat4(1.0f) };
+					jobs.push_back(job);
+				}
+			return;
+		}
+		const JsonValue &scene = scenes[(size_t)document["scene"].asInt(0)];
+		const JsonValue &roots = scene["nodes"];
+		for (size_t n = 0; n < roots.size(); n++)
+			visitNode(roots[n].asInt(), glm::mat4(1.0f), 0);
+	}
+
+	// ------------------------------------------------------------------------
+	// A count, offset or length from the file as a size_t. Values that are negative, NaN or larger
+	// than limit are rejected before the cast, so the sum of two accepted values cannot wrap.
+	static bool sizeValue(const JsonValue &value, size_t limit, size_t &out)
+	{
+		double number = value.asNumber();
+		if (!(number >= 0.0) || number > (double)limit)
+			return false;
+		out = (size_t)number;
+		return true;
+	}
+
+	// [offset, viewEnd) for an accessor: where its data starts and where its view ends in the buffer
+	static bool viewRange(const JsonValue &accessor, const JsonValue &view, size_t bufferSize, size_t &offset, size_t &viewEnd)
+	{
+		size_t viewOffset, viewLength, accessorOffset;
+		if (!sizeValue(view["byteOffset"], bufferSize, viewOffset) || !sizeValue(view["byteLength"], bufferSize - viewOffset, viewLength)
+			|| !sizeValue(accessor["byteOffset"], viewLength, accessorOffset))
+			return false;
+		offset = viewOffset + accessorOffset;
+		viewEnd = viewOffset + viewLength;
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	// read accessor `index` as floats, `components` per element; integer data is converted, and
+	// scaled to [0, 1] / [-1, 1] when the accessor is normalized
+	bool readAccessor(int index, int components, std::vector<float> &out) const
+	{
+		const JsonValue &accessor = document["accessors"][(size_t)index];
+		if (accessor.isNull() || accessor.has("sparse"))
+			return false;
+		const std::string &type = accessor["type"].asString();
+		int typeComponents = type == "SCALAR" ? 1 : type == "VEC2" ? 2 : type == "VEC3" ? 3 : type == "VEC4" ? 4 : 0;
+		if (typeComponents != components)
+			return false;
+		int componentType = accessor["componentType"].asInt();
+		size_t componentSize = componentType == 5120 || componentType == 5121 ? 1 : componentType == 5122 || componentType == 5123 ? 2 : componentType == 5125 || componentType == 5126 ? 4 : 0;
+		if (componentSize == 0)
+			return false;
+		bool normalized = accessor["normalized"].asBool();
+
+		const JsonValue &view = document["bufferViews"][(size_t)accessor["bufferView"].asInt()];
+		size_t bufferIndex = (size_t)view["buffer"].asInt();
+		if (view.isNull() || bufferIndex >= buffers.size())
+			return false;
+		size_t elementSize = componentSize * components;
+		size_t stride = elementSize, count, offset, viewEnd;
+		if ((view.has("byteStride") && !sizeValue(view["byteStride"], 255, stride)) || stride < elementSize
+			|| !sizeValue(accessor["count"], buffers[bufferIndex].size, count) || !viewRange(accessor, view, buffers[bufferIndex].size, offset, viewEnd))
+			return false;
+		// the last element needs only elementSize bytes, not a whole stride
+		if (count > 0 && (elementSize > viewEnd - offset || count - 1 > (viewEnd - offset - elementSize) / stride))
+			return false;
+
+		out.resize(count * components);
+		const unsigned char *source = buffers[bufferIndex].data + offset;
+		for (size_t e = 0; e < count; e++, source += stride)
+			for (int c = 0; c < components; c++)
+			{
+				const unsigned char *bytes = source + c * componentSize;
+				float value;
+				switch (componentType)
+				{
+				case 5120: { signed char v; std::memcpy(&v, bytes, 1); value = normalized ? (v < -127 ? -1.0f : v / 127.0f) : v; break; }
+				case 5121: value = normalized ? bytes[0] / 255.0f : bytes[0]; break;
+				case 5122: { short v; std::memcpy(&v, bytes, 2); value = normalized ? (v < -32767 ? -1.0f : v / 32767.0f) : v; break; }
+				case 5123: { unsigned short v; std::memcpy(&v, bytes, 2); value = normalized ? v / 65535.0f : v; break; }
+				case 5125: { unsigned int v; std::memcpy(&v, bytes, 4); value = (float)v; break; }
+				default: std::memcpy(&value, bytes, 4); break;
+				}
+				out[e * components + c] = value;
+			}
+		return true;
+	}
+
+	// indices are read separately: 32-bit values do not survive a trip through float
+	bool readIndices(int index, std::vector<unsigned int> &out) const
+	{
+		const JsonValue &accessor = document["accessors"][(size_t)index];
+		int componentType = accessor["componentType"].asInt();
+		size_t componentSize = componentType == 5121 ? 1 : componentType == 5123 ? 2 : componentType == 5125 ? 4 : 0;
+		const JsonValue &view = document["bufferViews"][(size_t)accessor["bufferView"].asInt()];
+		size_t bufferIndex = (size_t)view["buffer"].asInt();
+		if (componentSize == 0 || accessor["type"].asString() != "SCALAR" || accessor.has("sparse") || view.isNull() || bufferIndex >= buffers.size())
+			return false;
+		size_t count, offset, viewEnd;
+		if (!sizeValue(accessor["count"], buffers[bufferIndex].size, count) || !viewRange(accessor, view, buffers[bufferIndex].size, offset, viewEnd)
+			|| count > (viewEnd - offset) / componentSize)
+			return false;
+		const unsigned char *source = buffers[bufferIndex].data + offset;
+		out.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (componentSize == 1)
+				out[i] = source[i];
+			else if (componentSize == 2)
+			{
+				unsigned short v;
+				std::memcpy(&v, source + i * 2, 2);
+				out[i] = v;
+			}
+			else
+				std::memcpy(&out[i], source + i * 4, 4);
+		}
+		return true;
+	}
+
+	// ------------------------------------------------------------------------
+	void addTexture(const JsonValue &textureInfo, const char *type, std::vector<Texture> &textures) const
+	{
+		if (textureInfo.isNull())
+			return;
+		const JsonValue &texture = document["textures"][(size_t)textureInfo["index"].asInt()];
+		const std::string &uri = document["images"][(size_t)texture["source"].asInt()]["uri"].asString();
+		if (uri.empty() || uri.compare(0, 5, "data:") == 0)
+			return;
+		Texture result;
+		result.id = 0;
+		result.type = type;
+		result.path = directory + uri;
+		textures.push_back(result);
+	}
+
+	bool decodePrimitive(const PrimitiveJob &job, ImportedMesh &mesh) const
+	{
+		const JsonValue &primitive = *job.primitive;
+		if (primitive["mode"].asInt(4) != 4)
+			return false;
+		const JsonValue &attributes = primitive["attributes"];
+		std::vector<float> positions, normals, texcoords, tangents;
+		if (!readAccessor(attributes["POSITION"].asInt(), 3, positions))
+			return false;
+		size_t count = positions.size() / 3;
+		mesh.hasNormals = attributes.has("NORMAL") && readAccessor(attributes["NORMAL"].asInt(), 3, normals) && normals.size() == count * 3;
+		// tangents are only meaningful together with the normals they were authored against
+		mesh.hasTangents = mesh.hasNormals && attributes.has("TANGENT") && readAccessor(attributes["TANGENT"].asInt(), 4, tangents) && tangents.size() == count * 4;
+		bool hasTexcoords = attributes.has("TEXCOORD_0") && readAccessor(attributes["TEXCOORD_0"].asInt(), 2, texcoords) && texcoords.size() == count * 2;
+
+		glm::mat3 normalTransform = normalMatrix(job.world);
+		glm::mat3 tangentTransform(job.world);
+		mesh.vertices.resize(count);
+		for (size_t v = 0; v < count; v++)
+		{
+			Vertex &vertex = mesh.vertices[v];
+			vertex.Position = glm::vec3(job.world * glm::vec4(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2], 1.0f));
+			if (hasTexcoords)
+				// glTF puts the UV origin top-left; the loader flips images, so flip V to match
+				vertex.TexCoords = glm::vec2(texcoords[v * 2], 1.0f - texcoords[v * 2 + 1]);
+			if (mesh.hasNormals)
+				vertex.Normal = glm::normalize(normalTransform * glm::vec3(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]));
+			if (mesh.hasTangents)
+			{
+				vertex.Tangent = glm::normalize(tangentTransform * glm::vec3(tangents[v * 4], tangents[v * 4 + 1], tangents[v * 4 + 2]));
+				// w carries the handedness; flipping V mirrors the UV space, so the bitangent flips too
+				vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * (tangents[v * 4 + 3] < 0.0f ? 1.0f : -1.0f);
+			}
+		}
+
+		if (primitive.has("indices"))
+		{
+			if (!readIndices(primitive["indices"].asInt(), mesh.indices))
+				return false;
+			for (size_t i = 0; i < mesh.indices.size(); i++)
+				if (mesh.indices[i] >= count)
+					return false;
+		}
+		else
+			for (unsigned int i = 0; i < count; i++)
+				mesh.indices.push_back(i);
+		mesh.indices.resize(mesh.indices.size() / 3 * 3);
+
+		// a mirroring transform turns the winding around
+		const glm::mat3 &m = tangentTransform;
+		if (glm::dot(glm::cross(m[0], m[1]), m[2]) < 0.0f)
+			for (size_t i = 0; i < mesh.indices.size(); i += 3)
+				std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+
+		mesh.name = job.mesh->operator[]("name").asString();
+		const JsonValue &material = document["materials"][(size_t)primitive["material"].asInt()];
+		addTexture(material["pbrMetallicRoughness"]["baseColorTexture"], "texture_diffuse", mesh.textures);
+		addTexture(material["normalTexture"], "texture_normal", mesh.textures);
+		return true;
+	}
+};
+
+inline bool importGltf(const char *path, std::vector<ImportedMesh> &meshes)
+{
+	GltfImporter importer;
+	return importer.import(path, meshes);
+}
+#endif
\ No newline at end of file
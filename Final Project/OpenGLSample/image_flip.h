@@ -0,0 +1,81 @@
+#ifndef IMAGE_FLIP_H
+#define IMAGE_FLIP_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up. There are three ways to
+// reconcile the two; the texture loaders take one of these.
+enum ImageFlip {
+	// flipImageVertically after decoding
+	IMAGE_FLIP_ROWS,
+	// stbi_set_flip_vertically_on_load: stb flips while the decoded rows are still in cache
+	IMAGE_FLIP_IN_DECODER,
+	// no CPU pass at all: rows stay top-down and the shaders flip V (FLIP_TEXCOORDS, see textureFeatures)
+	IMAGE_FLIP_NONE
+};
+
+// Swaps whole rows with memcpy through a scratch row that is kept per thread, so loaders running on
+// worker threads do not share it and repeated loads do not reallocate it.
+inline void flipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+	const size_t rowBytes = (size_t)width * channels;
+	static thread_local std::vector<unsigned char> scratch;
+	if (scratch.size() < rowBytes)
+		scratch.resize(rowBytes);
+	unsigned char *top = image;
+	unsigned char *bottom = image + (size_t)(height - 1) * rowBytes;
+	for (int j = 0; j < height / 2; ++j, top += rowBytes, bottom -= rowBytes)
+	{
+		std::memcpy(scratch.data(), top, rowBytes);
+		std::memcpy(top, bottom, rowBytes);
+		std::memcpy(bottom, scratch.data(), rowBytes);
+	}
+}
+
+// the original byte-at-a-time loop, kept as the benchmark baseline
+inline void flipImageVerticallyBytewise(unsigned char* image, int width, int height, int channels)
+{
+	for (int j = 0; j < height / 2; ++j)
+	{
+		int index1 = j * width * channels;
+		int index2 = (height - 1 - j) * width * channels;
+		for (int i = width * channels; i > 0; --i)
+		{
+			unsigned char tmp = image[index1];
+			image[index1] = image[index2];
+			image[index2] = tmp;
+			++index1;
+			++index2;
+		}
+	}
+}
+
+// Microbenchmark: both flips over a 4K RGBA image, best of `iterations` runs each, and a check that
+// they produce the same pixels.
+inline void benchmarkImageFlip(std::ostream &out, int iterations = 10)
+{
+	const int width = 3840, height = 2160, channels = 4;
+	std::vector<unsigned char> reference((size_t)width * height * channels);
+	for (size_t i = 0; i < reference.size(); i++)
+		reference[i] = (unsigned char)(i * 2654435761u >> 24);
+	std::vector<unsigned char> bytewise = reference, rows = reference;
+
+	double best[2] = { 1e30, 1e30 };
+	for (int run = 0; run < iterations; run++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		flipImageVerticallyBytewise(bytewise.data(), width, height, channels);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		flipImageVertically(rows.data(), width, height, channels);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		best[0] = std::min(best[0], std::chrono::duration<double, std::milli>(middle - start).count());
+		best[1] = std::min(best[1], std::chrono::duration<double, std::milli>(end - middle).count());
+	}
+	out << "Image flip 3840x2160 RGBA: bytewise " << best[0] << " ms, row swap " << best[1] << " ms"
+		<< (bytewise == rows ? "" : " (MISMATCH)") << std::endl;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,159 @@
+#ifndef IMPORTED_MESH_H
+#define IMPORTED_MESH_H
+
+#include "mesh.h"
+
+#include <climits>
+#include <string>
+#include <vector>
+
+// Geometry an importer produced on a worker thread, before anything touches OpenGL. Textures carry
+// their type and path only; importModel resolves them to GL ids on the render thread.
+struct ImportedMesh
+{
+	std::string name;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<Texture> textures;
+	bool hasNormals = false;
+	bool hasTangents = false;
+};
+
+// "models/crate.obj" -> "models/"; "crate.obj" -> ""
+inline std::string directoryOf(const std::string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// Zero-copy scanning over a mapped text file: every helper reads from [cursor, end) and advances the
+// cursor, nothing is copied or null-terminated.
+struct TextCursor
+{
+	const char *cursor;
+	const char *end;
+
+	bool atEnd() const { return cursor >= end; }
+
+	void skipSpace()
+	{
+		while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+			cursor++;
+	}
+
+	void skipLine()
+	{
+		while (cursor < end && *cursor != '\n')
+			cursor++;
+		if (cursor < end)
+			cursor++;
+	}
+
+	bool atLineEnd() const
+	{
+		return cursor >= end || *cursor == '\n' || *cursor == '#';
+	}
+
+	// next whitespace separated token of the current line; empty at the end of the line
+	std::pair<const char*, const char*> token()
+	{
+		skipSpace();
+		const char *start = cursor;
+		while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+			cursor++;
+		return std::make_pair(start, cursor);
+	}
+
+	// rest of the line without surrounding whitespace (names and file paths may contain spaces)
+	std::string restOfLine()
+	{
+		skipSpace();
+		const char *start = cursor;
+		while (cursor < end && *cursor != '\n')
+			cursor++;
+		const char *last = cursor;
+		while (last > start && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+			last--;
+		return std::string(start, last);
+	}
+
+	bool parseInt(int &value)
+	{
+		skipSpace();
+		bool negative = false;
+		if (cursor < end && (*cursor == '-' || *cursor == '+'))
+			negative = *cursor++ == '-';
+		if (cursor >= end || *cursor < '0' || *cursor > '9')
+			return false;
+		// the whole digit run is consumed either way; past INT_MAX it stops accumulating and fails,
+		// so a huge index can never wrap into a valid one
+		long long result = 0;
+		bool overflow = false;
+		while (cursor < end && *cursor >= '0' && *cursor <= '9')
+		{
+			if (!overflow)
+				result = result * 10 + (*cursor - '0');
+			overflow = overflow || result > INT_MAX;
+			cursor++;
+		}
+		if (overflow)
+			return false;
+		value = (int)(negative ? -result : result);
+		return true;
+	}
+
+	// decimal float with optional exponent; exact enough for mesh data and much faster than strtof,
+	// which would also need a terminated copy
+	bool parseFloat(float &value)
+	{
+		skipSpace();
+		bool negative = false;
+		if (cursor < end && (*cursor == '-' || *cursor == '+'))
+			negative = *cursor++ == '-';
+		double mantissa = 0.0;
+		bool digits = false;
+		while (cursor < end && *cursor >= '0' && *cursor <= '9')
+		{
+			mantissa = mantissa * 10.0 + (*cursor++ - '0');
+			digits = true;
+		}
+		int exponent = 0;
+		if (cursor < end && *cursor == '.')
+		{
+			cursor++;
+			while (cursor < end && *cursor >= '0' && *cursor <= '9')
+			{
+				mantissa = mantissa * 10.0 + (*cursor++ - '0');
+				exponent--;
+				digits = true;
+			}
+		}
+		if (!digits)
+			return false;
+		if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+		{
+			cursor++;
+			int power = 0;
+			if (parseInt(power))
+				exponent += power;
+		}
+		double scale = 1.0, base = 10.0;
+		for (int e = exponent < 0 ? -exponent : exponent; e > 0; e >>= 1, base *= base)
+			if (e & 1)
+				scale *= base;
+		double result = exponent < 0 ? mantissa / scale : mantissa * scale;
+		value = (float)(negative ? -result : result);
+		return true;
+	}
+};
+
+// token compare without building a string
+inline bool tokenIs(const std::pair<const char*, const char*> &token, const char *text)
+{
+	const char *p = token.first;
+	for (; *text; text++, p++)
+		if (p >= token.second || *p != *text)
+			return false;
+	return p == token.second;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "normal_matrix.h"
+
+#include <cstddef>
+#include <vector>
+
+// first vertex attribute location of the per-instance model matrix in the lighting shader;
+// a mat4 attribute occupies four consecutive locations (5, 6, 7 and 8)
+const GLuint INSTANCE_MODEL_LOCATION = 5;
+// first location of the per-instance normal matrix; a mat3 occupies 9, 10 and 11
+const GLuint INSTANCE_NORMAL_LOCATION = 9;
+
+// what the instance buffer stores for every instance
+struct InstanceData {
+	glm::mat4 Model;
+	glm::mat3 NormalMatrix;
+};
+
+// A vertex buffer of per-instance model and normal matrices. Attach it to a mesh's VAO once and the whole set of
+// instances is drawn with a single glDrawArraysInstanced instead of one model upload and draw per object.
+class InstanceBuffer
+{
+public:
+	unsigned int VBO;
+	// number of instances currently in the buffer
+	unsigned int count = 0;
+
+	InstanceBuffer()
+	{
+		glGenBuffers(1, &VBO);
+	}
+
+	// add the instance attributes to a VAO that already holds the mesh's vertex attributes
+	void attach(unsigned int VAO) const
+	{
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Model) + column * sizeof(glm::vec4)));
+			// advance once per instance instead of once per vertex
+			glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+		}
+		for (GLuint column = 0; column < 3; column++)
+		{
+			glEnableVertexAttribArray(INSTANCE_NORMAL_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, NormalMatrix) + column * sizeof(glm::vec3)));
+			glVertexAttribDivisor(INSTANCE_NORMAL_LOCATION + column, 1);
+		}
+		glBindVertexArray(0);
+	}
+
+	// replace all instance transforms, computing each normal matrix on the CPU;
+	// the buffer only grows, smaller updates orphan and refill it
+	void upload(const std::vector<glm::mat4> &transforms)
+	{
+		count = (unsigned int)transforms.size();
+		instances.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			instances[i].Model = transforms[i];
+			instances[i].NormalMatrix = normalMatrix(transforms[i]);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (count > capacity)
+		{
+			capacity = count;
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), &instances[0], GL_DYNAMIC_DRAW);
+		}
+		else if (count > 0)
+		{
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), &instances[0]);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// draw every instance of vertices [first, first + vertexCount) of the currently bound VAO
+	void drawArrays(GLenum mode, GLint first, GLsizei vertexCount) const
+	{
+		if (count > 0)
+			glDrawArraysInstanced(mode, first, vertexCount, count);
+	}
+
+private:
+	// number of instances the GL buffer has room for
+	unsigned int capacity = 0;
+	// staging copy reused between uploads
+	std::vector<InstanceData> instances;
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,308 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Small read-only JSON document, enough for glTF: parse once, then walk it with operator[].
+// Missing members and out-of-range items return a shared null value, so lookups chain safely:
+// doc["meshes"][0]["primitives"].
+class JsonValue
+{
+public:
+	enum Type {
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT
+	};
+
+	Type type = JSON_NULL;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	// array items, or object member values (keys holds the member names in the same order)
+	std::vector<JsonValue> items;
+	std::vector<std::string> keys;
+
+	bool isNull() const { return type == JSON_NULL; }
+	size_t size() const { return items.size(); }
+
+	const JsonValue &operator[](size_t index) const
+	{
+		return type == JSON_ARRAY && index < items.size() ? items[index] : null();
+	}
+	const JsonValue &operator[](int index) const
+	{
+		return index >= 0 ? (*this)[(size_t)index] : null();
+	}
+	const JsonValue &operator[](const char *key) const
+	{
+		if (type == JSON_OBJECT)
+			for (size_t i = 0; i < keys.size(); i++)
+				if (keys[i] == key)
+					return items[i];
+		return null();
+	}
+	bool has(const char *key) const
+	{
+		return !(*this)[key].isNull();
+	}
+
+	double asNumber(double fallback = 0.0) const { return type == JSON_NUMBER ? number : fallback; }
+	// numbers outside int (and NaN) give the fallback; converting them would be undefined
+	int asInt(int fallback = -1) const { return type == JSON_NUMBER && number >= INT_MIN && number <= INT_MAX ? (int)number : fallback; }
+	bool asBool(bool fallback = false) const { return type == JSON_BOOL ? boolean : fallback; }
+	const std::string &asString() const { return type == JSON_STRING ? string : null().string; }
+
+	// parse [begin, end); on failure returns false and describes the problem in error
+	static bool parse(const char *begin, const char *end, JsonValue &out, std::string &error)
+	{
+		Parser parser = { begin, end, begin, &error };
+		if (!parser.value(out, 0))
+			return false;
+		parser.skipSpace();
+		if (parser.cursor != end)
+			return parser.fail("trailing characters");
+		return true;
+	}
+
+private:
+	static const JsonValue &null()
+	{
+		static const JsonValue value;
+		return value;
+	}
+
+	struct Parser
+	{
+		const char *begin;
+		const char *end;
+		const char *cursor;
+		std::string *error;
+
+		bool fail(const char *what)
+		{
+			*error = std::string(what) + " at byte " + std::to_string(cursor - begin);
+			return false;
+		}
+
+		void skipSpace()
+		{
+			while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+				cursor++;
+		}
+
+		bool literal(const char *text)
+		{
+			const char *p = cursor;
+			for (; *text; text++, p++)
+				if (p >= end || *p != *text)
+					return false;
+			cursor = p;
+			return true;
+		}
+
+		bool value(JsonValue &out, int depth)
+		{
+			if (depth > 256)
+				return fail("nesting too deep");
+			skipSpace();
+			if (cursor >= end)
+				return fail("unexpected end");
+			switch (*cursor)
+			{
+			case '{': return object(out, depth);
+			case '[': return array(out, depth);
+			case '"': out.type = JSON_STRING; return string(out.string);
+			case 't': out.type = JSON_BOOL; out.boolean = true; return literal("true") || fail("bad literal");
+			case 'f': out.type = JSON_BOOL; out.boolean = false; return literal("false") || fail("bad literal");
+			case 'n': out.type = JSON_NULL; return literal("null") || fail("bad literal");
+			default: return numberValue(out);
+			}
+		}
+
+		bool object(JsonValue &out, int depth)
+		{
+			out.type = JSON_OBJECT;
+			cursor++;
+			skipSpace();
+			if (cursor < end && *cursor == '}')
+			{
+				cursor++;
+				return true;
+			}
+			for (;;)
+			{
+				skipSpace();
+				std::string key;
+				if (cursor >= end || *cursor != '"' || !string(key))
+					return fail("expected member name");
+				skipSpace();
+				if (cursor >= end || *cursor != ':')
+					return fail("expected ':'");
+				cursor++;
+				out.keys.push_back(key);
+				out.items.push_back(JsonValue());
+				if (!value(out.items.back(), depth + 1))
+					return false;
+				skipSpace();
+				if (cursor < end && *cursor == ',')
+				{
+					cursor++;
+					continue;
+				}
+				if (cursor < end && *cursor == '}')
+				{
+					cursor++;
+					return true;
+				}
+				return fail("expected ',' or '}'");
+			}
+		}
+
+		bool array(JsonValue &out, int depth)
+		{
+			out.type = JSON_ARRAY;
+			cursor++;
+			skipSpace();
+			if (cursor < end && *cursor == ']')
+			{
+				cursor++;
+				return true;
+			}
+			for (;;)
+			{
+				out.items.push_back(JsonValue());
+				if (!value(out.items.back(), depth + 1))
+					return false;
+				skipSpace();
+				if (cursor < end && *cursor == ',')
+				{
+					cursor++;
+					continue;
+				}
+				if (cursor < end && *cursor == ']')
+				{
+					cursor++;
+					return true;
+				}
+				return fail("expected ',' or ']'");
+			}
+		}
+
+		bool numberValue(JsonValue &out)
+		{
+			// strtod needs a terminated string; numbers are short, so copy the token
+			const char *start = cursor;
+			while (cursor < end && *cursor != '\0' && std::strchr("+-0123456789.eE", *cursor) != nullptr)
+				cursor++;
+			if (cursor == start)
+				return fail("unexpected character");
+			std::string token(start, cursor);
+			char *parsedEnd = nullptr;
+			out.type = JSON_NUMBER;
+			out.number = std::strtod(token.c_str(), &parsedEnd);
+			if (parsedEnd != token.c_str() + token.size())
+				return fail("bad number");
+			return true;
+		}
+
+		static void appendUtf8(std::string &text, unsigned int codepoint)
+		{
+			if (codepoint < 0x80)
+				text += (char)codepoint;
+			else if (codepoint < 0x800)
+			{
+				text += (char)(0xc0 | (codepoint >> 6));
+				text += (char)(0x80 | (codepoint & 0x3f));
+			}
+			else if (codepoint < 0x10000)
+			{
+				text += (char)(0xe0 | (codepoint >> 12));
+				text += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+				text += (char)(0x80 | (codepoint & 0x3f));
+			}
+			else
+			{
+				text += (char)(0xf0 | (codepoint >> 18));
+				text += (char)(0x80 | ((codepoint >> 12) & 0x3f));
+				text += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+				text += (char)(0x80 | (codepoint & 0x3f));
+			}
+		}
+
+		bool hex4(unsigned int &codepoint)
+		{
+			if (end - cursor < 4)
+				return false;
+			codepoint = 0;
+			for (int i = 0; i < 4; i++, cursor++)
+			{
+				char c = *cursor;
+				codepoint <<= 4;
+				if (c >= '0' && c <= '9') codepoint |= (unsigned int)(c - '0');
+				else if (c >= 'a' && c <= 'f') codepoint |= (unsigned int)(c - 'a' + 10);
+				else if (c >= 'A' && c <= 'F') codepoint |= (unsigned int)(c - 'A' + 10);
+				else return false;
+			}
+			return true;
+		}
+
+		bool string(std::string &text)
+		{
+			cursor++; // opening quote
+			while (cursor < end && *cursor != '"')
+			{
+				if (*cursor != '\\')
+				{
+					text += *cursor++;
+					continue;
+				}
+				if (++cursor >= end)
+					break;
+				char escape = *cursor++;
+				switch (escape)
+				{
+				case '"': text += '"'; break;
+				case '\\': text += '\\'; break;
+				case '/': text += '/'; break;
+				case 'b': text += '\b'; break;
+				case 'f': text += '\f'; break;
+				case 'n': text += '\n'; break;
+				case 'r': text += '\r'; break;
+				case 't': text += '\t'; break;
+				case 'u':
+				{
+					unsigned int codepoint;
+					if (!hex4(codepoint))
+						return fail("bad \\u escape");
+					// surrogate pair
+					if (codepoint >= 0xd800 && codepoint < 0xdc00 && end - cursor >= 6 && cursor[0] == '\\' && cursor[1] == 'u')
+					{
+						cursor += 2;
+						unsigned int low;
+						if (!hex4(low))
+							return fail("bad \\u escape");
+						codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+					}
+					appendUtf8(text, codepoint);
+					break;
+				}
+				default:
+					return fail("bad escape");
+				}
+			}
+			if (cursor >= end)
+				return fail("unterminated string");
+			cursor++; // closing quote
+			return true;
+		}
+	};
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#ifndef LIGHT_BLOCK_H
+#define LIGHT_BLOCK_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+#include <cstddef>
+#include <cstring>
+
+// number of point lights in the LightBlock; must match NR_POINT_LIGHTS in the lighting shaders
+const unsigned int NR_POINT_LIGHTS = 4;
+// uniform buffer binding point every lit program attaches its LightBlock to
+const GLuint LIGHT_BLOCK_BINDING = 0;
+
+// std140 mirrors of the light structs in shaderfiles/6.multiple_lights.fs. A vec3 always starts on a
+// 16 byte boundary, a following float may use its fourth component, and every other gap is explicit padding.
+struct DirLightStd140 {
+	glm::vec3 direction;
+	float pad0;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+struct PointLightStd140 {
+	glm::vec3 position;
+	float constant;
+	float linear;
+	float quadratic;
+	float pad0[2];
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+struct SpotLightStd140 {
+	glm::vec3 position;
+	float pad0;
+	glm::vec3 direction;
+	float cutOff;
+	float outerCutOff;
+	float constant;
+	float linear;
+	float quadratic;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+
+struct LightBlock {
+	DirLightStd140 dirLight;
+	PointLightStd140 pointLights[NR_POINT_LIGHTS];
+	SpotLightStd140 spotLight;
+};
+
+// offsets the GLSL compiler assigns under std140; a mismatch here means the shader reads garbage
+static_assert(sizeof(DirLightStd140) == 64, "DirLight must be 64 bytes under std140");
+static_assert(offsetof(PointLightStd140, linear) == 16 && offsetof(PointLightStd140, ambient) == 32, "PointLight std140 layout");
+static_assert(sizeof(PointLightStd140) == 80, "PointLight must be 80 bytes under std140");
+static_assert(offsetof(SpotLightStd140, cutOff) == 28 && offsetof(SpotLightStd140, ambient) == 48, "SpotLight std140 layout");
+static_assert(sizeof(SpotLightStd140) == 96, "SpotLight must be 96 bytes under std140");
+static_assert(offsetof(LightBlock, pointLights) == 64 && offsetof(LightBlock, spotLight) == 384, "LightBlock std140 layout");
+static_assert(sizeof(LightBlock) == 480, "LightBlock must be 480 bytes under std140");
+
+// Owns the uniform buffer behind the LightBlock. Edit `lights` freely; upload() sends the whole
+// block in a single glBufferSubData, and only when it differs from what the GPU already has.
+class LightBuffer
+{
+public:
+	LightBlock lights;
+	unsigned int UBO;
+	// how many upload() calls sent data and how many found nothing to do
+	unsigned int uploads = 0;
+	unsigned int skippedUploads = 0;
+
+	LightBuffer(GLuint binding = LIGHT_BLOCK_BINDING) : binding(binding)
+	{
+		std::memset(static_cast<void *>(&lights), 0, sizeof(LightBlock));
+		std::memset(static_cast<void *>(&uploaded), 0, sizeof(LightBlock));
+
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+	}
+
+	// point a program's LightBlock at this buffer's binding point
+	void attach(Shader &shader) const
+	{
+		shader.bindUniformBlock("LightBlock", binding);
+	}
+
+	// returns true if the block changed and was sent to the GPU
+	bool upload()
+	{
+		if (hasUploaded && std::memcmp(&lights, &uploaded, sizeof(LightBlock)) == 0)
+		{
+			skippedUploads++;
+			return false;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &lights);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		uploaded = lights;
+		hasUploaded = true;
+		uploads++;
+		return true;
+	}
+
+private:
+	GLuint binding;
+	// copy of what the GPU currently holds
+	LightBlock uploaded;
+	bool hasUploaded = false;
+};
+#endif
\ No newline at end of file
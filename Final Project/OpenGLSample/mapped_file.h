@@ -0,0 +1,130 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read-only into memory. The pages are loaded on first touch by the OS, so reading
+// a large asset costs no parsing and no copy into a user buffer. Unmapped on close() or destruction.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	explicit MappedFile(const char *path)
+	{
+		open(path);
+	}
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool open(const char *path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER length;
+		if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			close();
+			return false;
+		}
+		bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		byteCount = (size_t)length.QuadPart;
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void *memory = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps the file alive on its own
+		::close(fd);
+		if (memory == MAP_FAILED)
+			return false;
+		bytes = (const unsigned char*)memory;
+		byteCount = (size_t)info.st_size;
+#endif
+		if (bytes == nullptr)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (bytes)
+			UnmapViewOfFile(bytes);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes)
+			munmap((void*)bytes, byteCount);
+#endif
+		bytes = nullptr;
+		byteCount = 0;
+	}
+
+	bool isOpen() const { return bytes != nullptr; }
+	const unsigned char *data() const { return bytes; }
+	size_t size() const { return byteCount; }
+
+private:
+	const unsigned char *bytes = nullptr;
+	size_t byteCount = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+// modification time in seconds, 0 if the file does not exist; used to tell whether a baked or cached
+// file is still newer than its source
+inline long long fileModifiedTime(const std::string &path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return 0;
+	return (long long)info.st_mtime;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef MATERIAL_REGIONS_H
+#define MATERIAL_REGIONS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// vertex attribute locations of the material data in the lighting shader's TEXTURE_ARRAYS path,
+// after the instance matrices (5-11)
+const GLuint MATERIAL_DIFFUSE_RECT_LOCATION = 12;
+const GLuint MATERIAL_SPECULAR_RECT_LOCATION = 13;
+const GLuint MATERIAL_LAYERS_LOCATION = 14;
+
+// Where one image lives inside a GL_TEXTURE_2D_ARRAY (see TextureArrayPacker): a layer, and the image's
+// offset and scale within it in texture coordinates. A whole layer is (0, 0, 1, 1).
+struct TextureRegion {
+	GLuint texture = 0;
+	float layer = 0.0f;
+	glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+// what the lighting shader needs to find a mesh's diffuse and specular images
+struct MaterialRegions {
+	glm::vec4 DiffuseRect;
+	glm::vec4 SpecularRect;
+	// diffuse layer, specular layer
+	glm::vec2 Layers;
+};
+
+inline MaterialRegions materialRegions(const TextureRegion &diffuse, const TextureRegion &specular)
+{
+	MaterialRegions regions;
+	regions.DiffuseRect = diffuse.rect;
+	regions.SpecularRect = specular.rect;
+	regions.Layers = glm::vec2(diffuse.layer, specular.layer);
+	return regions;
+}
+
+// Sets the regions as constant vertex attributes for the following non-instanced draws. These are
+// current-attribute values rather than a binding, so switching materials inside a texture array costs
+// no texture bind and no buffer update.
+inline void setMaterialRegions(const MaterialRegions &regions)
+{
+	glVertexAttrib4fv(MATERIAL_DIFFUSE_RECT_LOCATION, &regions.DiffuseRect[0]);
+	glVertexAttrib4fv(MATERIAL_SPECULAR_RECT_LOCATION, &regions.SpecularRect[0]);
+	glVertexAttrib2fv(MATERIAL_LAYERS_LOCATION, &regions.Layers[0]);
+}
+
+// Reads the regions per instance from VBO (one MaterialRegions per instance) instead, so one instanced
+// draw can mix materials that share the arrays.
+inline void attachMaterialRegions(GLuint VAO, GLuint VBO)
+{
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glEnableVertexAttribArray(MATERIAL_DIFFUSE_RECT_LOCATION);
+	glVertexAttribPointer(MATERIAL_DIFFUSE_RECT_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(MaterialRegions), (void*)offsetof(MaterialRegions, DiffuseRect));
+	glVertexAttribDivisor(MATERIAL_DIFFUSE_RECT_LOCATION, 1);
+	glEnableVertexAttribArray(MATERIAL_SPECULAR_RECT_LOCATION);
+	glVertexAttribPointer(MATERIAL_SPECULAR_RECT_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(MaterialRegions), (void*)offsetof(MaterialRegions, SpecularRect));
+	glVertexAttribDivisor(MATERIAL_SPECULAR_RECT_LOCATION, 1);
+	glEnableVertexAttribArray(MATERIAL_LAYERS_LOCATION);
+	glVertexAttribPointer(MATERIAL_LAYERS_LOCATION, 2, GL_FLOAT, GL_FALSE, sizeof(MaterialRegions), (void*)offsetof(MaterialRegions, Layers));
+	glVertexAttribDivisor(MATERIAL_LAYERS_LOCATION, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+#endif
\ No newline at end of file
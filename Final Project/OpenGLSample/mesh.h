@@ -7,9 +7,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "material_regions.h"
+#include "mesh_arena.h"
+#include "vertex_format.h"
+#include "allocation_counter.h"
 
+#include <cstddef>
 #include <string>
 #include <vector>
+#include <utility>
 using namespace std;
 
 struct Vertex {
@@ -25,42 +31,237 @@ struct Vertex {
 	glm::vec3 Bitangent;
 };
 
+// VertexFormat::full() mirrors this struct
+static_assert(sizeof(Vertex) == 56 && offsetof(Vertex, TexCoords) == 24 && offsetof(Vertex, Bitangent) == 44, "Vertex layout must match VertexFormat::full()");
+
 struct Texture {
 	unsigned int id;
 	string type;
 	string path;
 };
 
+// MESH_GPU_ONLY frees the vertex and index arrays once they are in the arena; keep the CPU copy
+// only for meshes that are read back later (picking, collision, re-export)
+enum MeshStorage {
+	MESH_KEEP_CPU_COPY,
+	MESH_GPU_ONLY
+};
+
 class Mesh {
 public:
 	// mesh Data
 	vector<Vertex>       vertices;
 	vector<unsigned int> indices;
 	vector<Texture>      textures;
+	// VAO of the arena block the mesh lives in, shared with other meshes
 	unsigned int VAO;
+	// the mesh's range of the arena's vertex and index buffers
+	MeshAllocation allocation;
+	// layout of the uploaded vertices; shaders drawing a packed mesh need format->defines
+	const VertexFormat *format;
+	// set by useTextureRegions: the mesh's images inside TextureArrayPacker arrays, for shaders built with
+	// LIGHTING_TEXTURE_ARRAYS
+	TextureRegion diffuseRegion;
+	TextureRegion specularRegion;
 
-	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	// heap allocations made by Draw calls that found their samplers cached; should stay zero
+	static unsigned long long &steadyStateAllocations()
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		static unsigned long long allocations = 0;
+		return allocations;
+	}
 
+	// constructor; the arrays are moved in, never copied. Loaders should run optimizeMesh
+	// (mesh_optimizer.h) on them first, the order given here is the order the GPU sees.
+	Mesh(vector<Vertex> &&vertices, vector<unsigned int> &&indices, vector<Texture> &&textures, MeshStorage storage = MESH_KEEP_CPU_COPY, const VertexFormat &format = VertexFormat::full())
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), VAO(0), format(&format)
+	{
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
 		setupMesh();
+		if (storage == MESH_GPU_ONLY)
+			releaseCpuCopy();
+	}
+
+	// GPU-only mesh from vertex and index data that is already in the format's layout, e.g. a memory
+	// mapped mesh cache; the data is uploaded straight from the given pointers
+	Mesh(const VertexFormat &format, const void *vertexData, unsigned int vertexCount, const void *indexData, unsigned int indexCount, GLenum indexType, vector<Texture> &&textures)
+		: textures(std::move(textures)), VAO(0), format(&format)
+	{
+		allocation = MeshArena::get().allocate(format, vertexData, vertexCount, indexData, indexCount, indexType);
+		VAO = MeshArena::get().vao(allocation);
+	}
+
+	// a mesh owns its arena range, so it can be moved but not copied
+	Mesh(const Mesh &) = delete;
+	Mesh &operator=(const Mesh &) = delete;
+
+	Mesh(Mesh &&other) noexcept
+		: vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)), VAO(other.VAO), allocation(other.allocation), format(other.format),
+		diffuseRegion(other.diffuseRegion), specularRegion(other.specularRegion), regions(other.regions), samplerCaches(std::move(other.samplerCaches))
+	{
+		other.VAO = 0;
+		other.allocation = MeshAllocation();
+	}
+
+	Mesh &operator=(Mesh &&other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			vertices = std::move(other.vertices);
+			indices = std::move(other.indices);
+			textures = std::move(other.textures);
+			VAO = other.VAO;
+			allocation = other.allocation;
+			format = other.format;
+			diffuseRegion = other.diffuseRegion;
+			specularRegion = other.specularRegion;
+			regions = other.regions;
+			samplerCaches = std::move(other.samplerCaches);
+			other.VAO = 0;
+			other.allocation = MeshAllocation();
+		}
+		return *this;
+	}
+
+	// a moved-from mesh holds a reset allocation, so this gives nothing back twice
+	~Mesh()
+	{
+		release();
+	}
+
+	// give the mesh's range back to the arena (textures are owned elsewhere)
+	void release()
+	{
+		MeshArena::get().release(allocation);
+		VAO = 0;
+	}
+
+	// drop the CPU copy of a MESH_KEEP_CPU_COPY mesh once nothing reads it back; drawing is unaffected
+	void releaseCpuCopy()
+	{
+		// swap with empty vectors, clear() would keep the capacity
+		vector<Vertex>().swap(vertices);
+		vector<unsigned int>().swap(indices);
+	}
+
+	// Draw the mesh from texture arrays: it binds the regions' arrays to units 0 and 1, which are shared
+	// with every other mesh in the same arrays, and passes the layers and rects as vertex attributes
+	void useTextureRegions(const TextureRegion &diffuse, const TextureRegion &specular)
+	{
+		diffuseRegion = diffuse;
+		specularRegion = specular;
+		regions = materialRegions(diffuse, specular);
+	}
+
+	// the vertex bytes exactly as they are uploaded for this mesh's format (see vertex_format.h);
+	// needs the CPU copy
+	vector<unsigned char> packVertices() const
+	{
+		const unsigned int stride = format->stride;
+		if (!format->packed)
+		{
+			const unsigned char *bytes = (const unsigned char*)vertices.data();
+			return vector<unsigned char>(bytes, bytes + vertices.size() * sizeof(Vertex));
+		}
+		const unsigned int normalOffset = format->position == POSITION_HALF ? 8 : 12;
+		vector<unsigned char> packed(vertices.size() * stride, 0);
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			const Vertex &vertex = vertices[i];
+			unsigned char *out = &packed[i * stride];
+			if (format->position == POSITION_HALF)
+			{
+				unsigned short position[4] = { packHalf(vertex.Position.x), packHalf(vertex.Position.y), packHalf(vertex.Position.z), 0 };
+				memcpy(out, position, sizeof(position));
+			}
+			else
+				memcpy(out, &vertex.Position, sizeof(glm::vec3));
+
+			glm::vec2 normal = octEncode(vertex.Normal);
+			glm::vec2 tangent = octEncode(vertex.Tangent);
+			// the bitangent is rebuilt in the shader as cross(normal, tangent) * sign
+			float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+			unsigned int packedNormal = packSnorm2_10_10_10(normal.x, normal.y, 0.0f, 1.0f);
+			unsigned int packedTangent = packSnorm2_10_10_10(tangent.x, tangent.y, 0.0f, handedness);
+			unsigned short uv[2] = { packHalf(vertex.TexCoords.x), packHalf(vertex.TexCoords.y) };
+			memcpy(out + normalOffset, &packedNormal, 4);
+			memcpy(out + normalOffset + 4, &packedTangent, 4);
+			memcpy(out + normalOffset + 8, uv, 4);
+		}
+		return packed;
 	}
 
 	// render the mesh
 	void Draw(Shader &shader)
 	{
-		// bind appropriate textures
+		unsigned long long allocationsBefore = AllocationCounter::count();
+		const SamplerCache *cached = findSamplers(shader);
+		const SamplerCache &samplers = cached ? *cached : resolveSamplers(shader);
+
+		if (diffuseRegion.texture != 0)
+		{
+			// material.diffuse and material.specular stay on units 0 and 1; consecutive meshes in the same
+			// arrays bind nothing, the state cache filters it
+			GLState::get().bindTexture(0, GL_TEXTURE_2D_ARRAY, diffuseRegion.texture);
+			GLState::get().bindTexture(1, GL_TEXTURE_2D_ARRAY, specularRegion.texture);
+			setMaterialRegions(regions);
+		}
+		else
+		{
+			// bind appropriate textures
+			for (unsigned int i = 0; i < textures.size(); i++)
+			{
+				// now set the sampler to the correct texture unit (filtered by the shader's value shadow)
+				shader.setInt(samplers.uniforms[i], i);
+				// and finally bind the texture (the state cache selects the unit only if the bind is issued)
+				GLState::get().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+			}
+		}
+
+		// draw mesh
+		MeshArena::get().draw(allocation);
+		glBindVertexArray(0);
+
+		// always good practice to set everything back to defaults once configured.
+		GLState::get().activeTexture(0);
+
+		if (cached)
+			steadyStateAllocations() += AllocationCounter::count() - allocationsBefore;
+	}
+
+private:
+	// sampler uniforms (diffuse_texture1, specular_texture1, ...) of this mesh's textures in one program;
+	// a hot reload bumps the shader's generation and the entry is resolved again
+	struct SamplerCache
+	{
+		GLuint program;
+		unsigned int generation;
+		vector<UniformHandle> uniforms;
+	};
+	MaterialRegions regions;
+	vector<SamplerCache> samplerCaches;
+
+	const SamplerCache *findSamplers(const Shader &shader) const
+	{
+		for (size_t i = 0; i < samplerCaches.size(); i++)
+			if (samplerCaches[i].program == shader.ID && samplerCaches[i].generation == shader.generation)
+				return &samplerCaches[i];
+		return nullptr;
+	}
+
+	// the only place Draw builds names; runs once per (mesh, shader)
+	const SamplerCache &resolveSamplers(const Shader &shader)
+	{
+		SamplerCache cache;
+		cache.program = shader.ID;
+		cache.generation = shader.generation;
 		unsigned int diffuseNr = 1;
 		unsigned int specularNr = 1;
 		unsigned int normalNr = 1;
 		unsigned int heightNr = 1;
 		for (unsigned int i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
 			// retrieve texture number (the N in diffuse_textureN)
 			string number;
 			string name = textures[i].type;
@@ -72,63 +273,48 @@ public:
 				number = std::to_string(normalNr++); // transfer unsigned int to stream
 			else if (name == "texture_height")
 				number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// and finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			cache.uniforms.push_back(shader.uniform((name + number).c_str()));
 		}
-
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
+		// reuse the slot of an older generation under the same program id
+		for (size_t i = 0; i < samplerCaches.size(); i++)
+			if (samplerCaches[i].program == cache.program)
+			{
+				samplerCaches[i] = std::move(cache);
+				return samplerCaches[i];
+			}
+		samplerCaches.push_back(std::move(cache));
+		return samplerCaches.back();
 	}
 
-private:
-	// render data 
-	unsigned int VBO, EBO;
-
-	// initializes all the buffer objects/arrays
+	// copies the vertex and index data into the shared arena; the attribute pointers come from the
+	// format and are set up once per arena block rather than once per mesh
 	void setupMesh()
 	{
-		// create buffers/arrays
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
-
-		glBindVertexArray(VAO);
-		// load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		// A great thing about structs is that their memory layout is sequential for all its items.
-		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-		// set the vertex attribute pointers
-		// vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		// the arena draws with a base vertex, so indices only have to address this mesh's own vertices
+		// and anything up to 65536 vertices gets half-size indices
+		vector<unsigned short> shortIndices;
+		const void *indexData = indices.data();
+		GLenum indexType = GL_UNSIGNED_INT;
+		if (vertices.size() <= 65536)
+		{
+			shortIndices.assign(indices.begin(), indices.end());
+			indexData = shortIndices.data();
+			indexType = GL_UNSIGNED_SHORT;
+		}
 
-		glBindVertexArray(0);
+		if (!format->packed)
+		{
+			// A great thing about structs is that their memory layout is sequential for all its items.
+			// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+			// again translates to 3/2 floats which translates to a byte array.
+			allocation = MeshArena::get().allocate(*format, vertices.data(), (unsigned int)vertices.size(), indexData, (unsigned int)indices.size(), indexType);
+		}
+		else
+		{
+			vector<unsigned char> packed = packVertices();
+			allocation = MeshArena::get().allocate(*format, packed.data(), (unsigned int)vertices.size(), indexData, (unsigned int)indices.size(), indexType);
+		}
+		VAO = MeshArena::get().vao(allocation);
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,281 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <glad/glad.h>
+
+#include "vertex_format.h"
+
+#include <map>
+#include <vector>
+#include <iostream>
+
+// First-fit allocator over [0, capacity) that merges neighbouring free ranges on release.
+// Units are whatever the caller counts in (vertices or indices here).
+class RangeAllocator
+{
+public:
+	static const unsigned int NONE = 0xffffffffu;
+
+	unsigned int capacity;
+	unsigned int used = 0;
+
+	explicit RangeAllocator(unsigned int capacity = 0) : capacity(capacity)
+	{
+		if (capacity > 0)
+			freeRanges[0] = capacity;
+	}
+
+	// offset of a free range of `size` units, or NONE
+	unsigned int allocate(unsigned int size)
+	{
+		if (size == 0)
+			return 0;
+		for (std::map<unsigned int, unsigned int>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second < size)
+				continue;
+			unsigned int offset = it->first;
+			unsigned int remaining = it->second - size;
+			freeRanges.erase(it);
+			if (remaining > 0)
+				freeRanges[offset + size] = remaining;
+			used += size;
+			return offset;
+		}
+		return NONE;
+	}
+
+	void free(unsigned int offset, unsigned int size)
+	{
+		if (size == 0)
+			return;
+		used -= size;
+		std::map<unsigned int, unsigned int>::iterator next = freeRanges.lower_bound(offset);
+		// merge with the range that ends where this one starts
+		if (next != freeRanges.begin())
+		{
+			std::map<unsigned int, unsigned int>::iterator previous = next;
+			--previous;
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				size += previous->second;
+				freeRanges.erase(previous);
+			}
+		}
+		// and with the one that starts where it ends
+		if (next != freeRanges.end() && offset + size == next->first)
+		{
+			size += next->second;
+			freeRanges.erase(next);
+		}
+		freeRanges[offset] = size;
+	}
+
+private:
+	// offset -> size of every free range
+	std::map<unsigned int, unsigned int> freeRanges;
+};
+
+// where one mesh lives inside the arena
+struct MeshAllocation
+{
+	int block = -1;
+	unsigned int firstVertex = 0;
+	unsigned int vertexCount = 0;
+	unsigned int firstIndex = 0;
+	unsigned int indexCount = 0;
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum indexType = GL_UNSIGNED_INT;
+	// MeshArena::clear() count when the range was handed out; older allocations are dead
+	unsigned int generation = 0;
+
+	bool valid() const { return block >= 0; }
+};
+
+// Shared vertex/index storage for every Mesh. Instead of a VAO, VBO and EBO per mesh, meshes with the
+// same VertexFormat and index type are packed into a few large blocks (one VAO + VBO + EBO each) and
+// addressed by offset: indices stay relative to the mesh and the draw adds the base vertex, which is
+// what lets any mesh of up to 65536 vertices use 16-bit indices wherever it lands in the block.
+class MeshArena
+{
+public:
+	// size of a regular block; a mesh that does not fit gets a block of its own
+	static const unsigned int VERTEX_BLOCK_BYTES = 16u << 20;
+	static const unsigned int INDEX_BLOCK_COUNT = 4u << 20;
+
+	static MeshArena &get()
+	{
+		static MeshArena arena;
+		return arena;
+	}
+
+	// copy a mesh into the arena; the caller may free its arrays afterwards
+	// ------------------------------------------------------------------------
+	MeshAllocation allocate(const VertexFormat &format, const void *vertices, unsigned int vertexCount, const void *indices, unsigned int indexCount, GLenum indexType = GL_UNSIGNED_INT)
+	{
+		unsigned int stride = format.stride;
+		unsigned int indexSize = indexTypeSize(indexType);
+		MeshAllocation allocation;
+		allocation.indexType = indexType;
+		allocation.generation = generation;
+		for (size_t i = 0; i < blocks.size() && !allocation.valid(); i++)
+			if (blocks[i].format == &format && blocks[i].indexType == indexType)
+				reserve(blocks[i], (int)i, vertexCount, indexCount, allocation);
+		if (!allocation.valid())
+		{
+			unsigned int vertexCapacity = VERTEX_BLOCK_BYTES / stride;
+			blocks.push_back(createBlock(format, indexType, vertexCount > vertexCapacity ? vertexCount : vertexCapacity, indexCount > INDEX_BLOCK_COUNT ? indexCount : INDEX_BLOCK_COUNT));
+			reserve(blocks.back(), (int)blocks.size() - 1, vertexCount, indexCount, allocation);
+		}
+
+		const Block &block = blocks[allocation.block];
+		if (vertexCount > 0)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, block.VBO);
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)allocation.firstVertex * stride, (GLsizeiptr)vertexCount * stride, vertices);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		if (indexCount > 0)
+		{
+			// the element buffer is VAO state, so bind the VAO before touching it
+			glBindVertexArray(block.VAO);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)allocation.firstIndex * indexSize, (GLsizeiptr)indexCount * indexSize, indices);
+			glBindVertexArray(0);
+		}
+		allocations++;
+		return allocation;
+	}
+	// return a mesh's ranges to the arena; the allocation is reset
+	// ------------------------------------------------------------------------
+	void release(MeshAllocation &allocation)
+	{
+		if (!live(allocation))
+			return;
+		Block &block = blocks[allocation.block];
+		block.vertices.free(allocation.firstVertex, allocation.vertexCount);
+		block.indices.free(allocation.firstIndex, allocation.indexCount);
+		allocations--;
+		allocation = MeshAllocation();
+	}
+	// VAO to bind for drawing an allocation
+	// ------------------------------------------------------------------------
+	GLuint vao(const MeshAllocation &allocation) const
+	{
+		return live(allocation) ? blocks[allocation.block].VAO : 0;
+	}
+	// draw an allocation's triangles; leaves its block's VAO bound
+	// ------------------------------------------------------------------------
+	void draw(const MeshAllocation &allocation, GLenum mode = GL_TRIANGLES) const
+	{
+		if (!live(allocation) || allocation.indexCount == 0)
+			return;
+		glBindVertexArray(blocks[allocation.block].VAO);
+		glDrawElementsBaseVertex(mode, (GLsizei)allocation.indexCount, allocation.indexType, (void*)((size_t)allocation.firstIndex * indexTypeSize(allocation.indexType)), (GLint)allocation.firstVertex);
+	}
+	// delete every block (application shutdown); outstanding allocations become invalid
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			glDeleteVertexArrays(1, &blocks[i].VAO);
+			glDeleteBuffers(1, &blocks[i].VBO);
+			glDeleteBuffers(1, &blocks[i].EBO);
+		}
+		blocks.clear();
+		allocations = 0;
+		generation++;
+	}
+	// ------------------------------------------------------------------------
+	void printStats(std::ostream &out) const
+	{
+		size_t vertexBytes = 0, vertexCapacity = 0, indexBytes = 0, indexCapacity = 0;
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			unsigned int indexSize = indexTypeSize(blocks[i].indexType);
+			vertexBytes += (size_t)blocks[i].vertices.used * blocks[i].stride;
+			vertexCapacity += (size_t)blocks[i].vertices.capacity * blocks[i].stride;
+			indexBytes += (size_t)blocks[i].indices.used * indexSize;
+			indexCapacity += (size_t)blocks[i].indices.capacity * indexSize;
+		}
+		out << "Mesh arena: " << allocations << " meshes in " << blocks.size() << " blocks, "
+			<< vertexBytes << " / " << vertexCapacity << " vertex bytes, "
+			<< indexBytes << " / " << indexCapacity << " index bytes" << std::endl;
+	}
+
+private:
+	struct Block
+	{
+		const VertexFormat *format;
+		unsigned int stride;
+		GLenum indexType;
+		GLuint VAO, VBO, EBO;
+		RangeAllocator vertices;
+		RangeAllocator indices;
+	};
+
+	std::vector<Block> blocks;
+	unsigned int allocations = 0;
+	unsigned int generation = 0;
+
+	MeshArena() {}
+	MeshArena(const MeshArena &) = delete;
+	MeshArena &operator=(const MeshArena &) = delete;
+
+	// a mesh that outlives clear() still holds its old block index, which may now be out of range or reused
+	bool live(const MeshAllocation &allocation) const
+	{
+		return allocation.valid() && allocation.generation == generation;
+	}
+
+	static unsigned int indexTypeSize(GLenum indexType)
+	{
+		return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	}
+
+	static void reserve(Block &block, int index, unsigned int vertexCount, unsigned int indexCount, MeshAllocation &allocation)
+	{
+		unsigned int firstVertex = block.vertices.allocate(vertexCount);
+		if (firstVertex == RangeAllocator::NONE)
+			return;
+		unsigned int firstIndex = block.indices.allocate(indexCount);
+		if (firstIndex == RangeAllocator::NONE)
+		{
+			block.vertices.free(firstVertex, vertexCount);
+			return;
+		}
+		allocation.block = index;
+		allocation.firstVertex = firstVertex;
+		allocation.vertexCount = vertexCount;
+		allocation.firstIndex = firstIndex;
+		allocation.indexCount = indexCount;
+	}
+
+	static Block createBlock(const VertexFormat &format, GLenum indexType, unsigned int vertexCapacity, unsigned int indexCapacity)
+	{
+		unsigned int stride = format.stride;
+		Block block;
+		block.format = &format;
+		block.stride = stride;
+		block.indexType = indexType;
+		block.vertices = RangeAllocator(vertexCapacity);
+		block.indices = RangeAllocator(indexCapacity);
+
+		glGenVertexArrays(1, &block.VAO);
+		glGenBuffers(1, &block.VBO);
+		glGenBuffers(1, &block.EBO);
+
+		glBindVertexArray(block.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, block.VBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCapacity * stride, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCapacity * indexTypeSize(indexType), NULL, GL_STATIC_DRAW);
+		// attribute offsets are relative to the block; each draw supplies its base vertex
+		format.setup();
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return block;
+	}
+};
+#endif
\ No newline at end of file
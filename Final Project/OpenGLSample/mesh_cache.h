@@ -0,0 +1,310 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "mapped_file.h"
+#include "vertex_format.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Binary mesh container ("GSMC"). Everything after the header is already in GPU layout, so loading is
+// mmap + validate + upload straight from the mapping:
+//
+//   MeshCacheHeader
+//   vertex blob     vertexCount * stride bytes in the named VertexFormat
+//   index blob      indexCount indices of indexType, relative to their submesh's baseVertex
+//   submesh table   submeshCount MeshCacheSubmesh
+//   texture table   textureCount MeshCacheTexture, each followed by its type and path bytes padded to 4
+//
+// Blobs start on 16 byte boundaries; the texture table follows the submesh table directly. Files are
+// little-endian and written by writeMeshCache.
+const unsigned int MESH_CACHE_MAGIC = 0x434d5347; // "GSMC"
+const unsigned int MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	// VertexFormat::name, zero padded
+	char format[16];
+	unsigned int stride;
+	unsigned int indexType;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int submeshCount;
+	unsigned int textureCount;
+	// byte offsets from the start of the file
+	unsigned long long vertexOffset;
+	unsigned long long indexOffset;
+	unsigned long long submeshOffset;
+	// bounds of every submesh together
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+struct MeshCacheSubmesh
+{
+	unsigned int baseVertex;
+	unsigned int vertexCount;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+// one of a submesh's textures; ids are not stored, the loader resolves the path again
+struct MeshCacheTexture
+{
+	unsigned int submesh;
+	// lengths of the type and path strings that follow, not terminated
+	unsigned int typeLength;
+	unsigned int pathLength;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 96, "MeshCacheHeader is part of the file format");
+static_assert(sizeof(MeshCacheSubmesh) == 40, "MeshCacheSubmesh is part of the file format");
+static_assert(sizeof(MeshCacheTexture) == 12, "MeshCacheTexture is part of the file format");
+
+// the cache file kept next to a model by importModel
+inline std::string meshCachePath(const std::string &model)
+{
+	return model + ".gsmc";
+}
+
+// A validated view of a mapped cache file; the pointers stay valid while the MeshCacheFile is open.
+class MeshCacheFile
+{
+public:
+	const MeshCacheHeader *header = nullptr;
+	const VertexFormat *format = nullptr;
+	const unsigned char *vertices = nullptr;
+	const unsigned char *indices = nullptr;
+	const MeshCacheSubmesh *submeshes = nullptr;
+	// per submesh, with id 0
+	std::vector<vector<Texture>> textures;
+
+	bool open(const char *path)
+	{
+		header = nullptr;
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(MeshCacheHeader))
+			return fail(path, "truncated header");
+		const MeshCacheHeader *candidate = (const MeshCacheHeader*)file.data();
+		if (candidate->magic != MESH_CACHE_MAGIC || candidate->version != MESH_CACHE_VERSION)
+			return fail(path, "not a mesh cache of this version");
+
+		// the name is not terminated when it fills all 16 bytes
+		std::string name(candidate->format, sizeof(candidate->format));
+		name = name.c_str();
+		format = VertexFormat::byName(name);
+		if (format == nullptr || format->stride != candidate->stride)
+			return fail(path, "unknown vertex format");
+		if (candidate->indexType != GL_UNSIGNED_SHORT && candidate->indexType != GL_UNSIGNED_INT)
+			return fail(path, "bad index type");
+
+		unsigned long long indexSize = candidate->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		if (!inside(candidate->vertexOffset, (unsigned long long)candidate->vertexCount * candidate->stride)
+			|| !inside(candidate->indexOffset, (unsigned long long)candidate->indexCount * indexSize)
+			|| !inside(candidate->submeshOffset, (unsigned long long)candidate->submeshCount * sizeof(MeshCacheSubmesh)))
+			return fail(path, "blob outside the file");
+		// the index blob and the submesh table are read in place, so they must be aligned for their types
+		if (candidate->indexOffset % indexSize != 0 || candidate->submeshOffset % alignof(MeshCacheSubmesh) != 0)
+			return fail(path, "misaligned blob");
+
+		vertices = file.data() + candidate->vertexOffset;
+		indices = file.data() + candidate->indexOffset;
+		submeshes = (const MeshCacheSubmesh*)(file.data() + candidate->submeshOffset);
+		for (unsigned int i = 0; i < candidate->submeshCount; i++)
+		{
+			const MeshCacheSubmesh &submesh = submeshes[i];
+			if ((unsigned long long)submesh.baseVertex + submesh.vertexCount > candidate->vertexCount
+				|| (unsigned long long)submesh.firstIndex + submesh.indexCount > candidate->indexCount)
+				return fail(path, "submesh outside the blobs");
+			// indices are relative to baseVertex; one past the submesh would read another submesh's
+			// vertices, or past the vertex blob
+			if (submesh.indexCount > 0 && maxIndex(candidate->indexType, submesh) >= submesh.vertexCount)
+				return fail(path, "index outside its submesh");
+		}
+
+		textures.assign(candidate->submeshCount, vector<Texture>());
+		unsigned long long offset = candidate->submeshOffset + (unsigned long long)candidate->submeshCount * sizeof(MeshCacheSubmesh);
+		for (unsigned int i = 0; i < candidate->textureCount; i++)
+		{
+			if (!inside(offset, sizeof(MeshCacheTexture)))
+				return fail(path, "texture table outside the file");
+			MeshCacheTexture record;
+			std::memcpy(&record, file.data() + offset, sizeof(record));
+			offset += sizeof(record);
+			if (record.submesh >= candidate->submeshCount || !inside(offset, (unsigned long long)record.typeLength + record.pathLength))
+				return fail(path, "bad texture record");
+			Texture texture;
+			texture.id = 0;
+			texture.type.assign((const char*)file.data() + offset, record.typeLength);
+			texture.path.assign((const char*)file.data() + offset + record.typeLength, record.pathLength);
+			textures[record.submesh].push_back(texture);
+			offset = (offset + record.typeLength + record.pathLength + 3) & ~3ull;
+		}
+		header = candidate;
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		header = nullptr;
+	}
+
+	// upload one submesh into the mesh arena, directly from the mapping
+	Mesh createMesh(unsigned int submesh, vector<Texture> &&textures = vector<Texture>()) const
+	{
+		const MeshCacheSubmesh &range = submeshes[submesh];
+		unsigned int indexSize = header->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		return Mesh(*format, vertices + (size_t)range.baseVertex * header->stride, range.vertexCount,
+			indices + (size_t)range.firstIndex * indexSize, range.indexCount, header->indexType, std::move(textures));
+	}
+
+private:
+	MappedFile file;
+
+	bool inside(unsigned long long offset, unsigned long long length) const
+	{
+		return offset <= file.size() && length <= file.size() - offset;
+	}
+
+	unsigned int maxIndex(unsigned int indexType, const MeshCacheSubmesh &submesh) const
+	{
+		unsigned int largest = 0;
+		if (indexType == GL_UNSIGNED_SHORT)
+		{
+			const unsigned short *first = (const unsigned short*)indices + submesh.firstIndex;
+			for (unsigned int i = 0; i < submesh.indexCount; i++)
+				largest = first[i] > largest ? first[i] : largest;
+		}
+		else
+		{
+			const unsigned int *first = (const unsigned int*)indices + submesh.firstIndex;
+			for (unsigned int i = 0; i < submesh.indexCount; i++)
+				largest = first[i] > largest ? first[i] : largest;
+		}
+		return largest;
+	}
+
+	bool fail(const char *path, const char *reason)
+	{
+		std::cout << "ERROR::MESH_CACHE::" << reason << ": " << path << std::endl;
+		file.close();
+		return false;
+	}
+};
+
+// Converter: write meshes that share one VertexFormat into a single cache file, one submesh each.
+// Every mesh needs its CPU copy (MESH_KEEP_CPU_COPY); indices are written 16-bit when every submesh allows it.
+inline bool writeMeshCache(const char *path, const std::vector<const Mesh*> &meshes)
+{
+	if (meshes.empty())
+		return false;
+	const VertexFormat &format = *meshes[0]->format;
+
+	MeshCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	std::strncpy(header.format, format.name, sizeof(header.format) - 1);
+	header.stride = format.stride;
+	header.indexType = GL_UNSIGNED_SHORT;
+
+	std::vector<MeshCacheSubmesh> submeshes(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh &mesh = *meshes[i];
+		if (mesh.format != &format || (mesh.vertices.empty() && mesh.allocation.vertexCount > 0))
+		{
+			std::cout << "ERROR::MESH_CACHE::meshes need the same format and a CPU copy: " << path << std::endl;
+			return false;
+		}
+		MeshCacheSubmesh &submesh = submeshes[i];
+		submesh.baseVertex = header.vertexCount;
+		submesh.vertexCount = (unsigned int)mesh.vertices.size();
+		submesh.firstIndex = header.indexCount;
+		submesh.indexCount = (unsigned int)mesh.indices.size();
+		glm::vec3 low(0.0f), high(0.0f);
+		for (size_t v = 0; v < mesh.vertices.size(); v++)
+		{
+			const glm::vec3 &p = mesh.vertices[v].Position;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (v == 0 || p[axis] < low[axis])
+					low[axis] = p[axis];
+				if (v == 0 || p[axis] > high[axis])
+					high[axis] = p[axis];
+			}
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			submesh.boundsMin[axis] = low[axis];
+			submesh.boundsMax[axis] = high[axis];
+			if (i == 0 || low[axis] < header.boundsMin[axis])
+				header.boundsMin[axis] = low[axis];
+			if (i == 0 || high[axis] > header.boundsMax[axis])
+				header.boundsMax[axis] = high[axis];
+		}
+		if (submesh.vertexCount > 65536)
+			header.indexType = GL_UNSIGNED_INT;
+		header.textureCount += (unsigned int)mesh.textures.size();
+		header.vertexCount += submesh.vertexCount;
+		header.indexCount += submesh.indexCount;
+	}
+	header.submeshCount = (unsigned int)submeshes.size();
+
+	unsigned long long indexSize = header.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	header.vertexOffset = (sizeof(MeshCacheHeader) + 15) & ~15ull;
+	header.indexOffset = (header.vertexOffset + (unsigned long long)header.vertexCount * header.stride + 15) & ~15ull;
+	header.submeshOffset = (header.indexOffset + header.indexCount * indexSize + 15) & ~15ull;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	const char padding[16] = { 0 };
+	file.write((const char*)&header, sizeof(header));
+	file.write(padding, (std::streamsize)(header.vertexOffset - sizeof(header)));
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		std::vector<unsigned char> bytes = meshes[i]->packVertices();
+		file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+	}
+	file.write(padding, (std::streamsize)(header.indexOffset - header.vertexOffset - (unsigned long long)header.vertexCount * header.stride));
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const std::vector<unsigned int> &indices = meshes[i]->indices;
+		if (header.indexType == GL_UNSIGNED_SHORT)
+		{
+			std::vector<unsigned short> narrow(indices.begin(), indices.end());
+			file.write((const char*)narrow.data(), (std::streamsize)(narrow.size() * 2));
+		}
+		else
+			file.write((const char*)indices.data(), (std::streamsize)(indices.size() * 4));
+	}
+	file.write(padding, (std::streamsize)(header.submeshOffset - header.indexOffset - header.indexCount * indexSize));
+	file.write((const char*)submeshes.data(), (std::streamsize)(submeshes.size() * sizeof(MeshCacheSubmesh)));
+	for (size_t i = 0; i < meshes.size(); i++)
+		for (size_t t = 0; t < meshes[i]->textures.size(); t++)
+		{
+			const Texture &texture = meshes[i]->textures[t];
+			MeshCacheTexture record = { (unsigned int)i, (unsigned int)texture.type.size(), (unsigned int)texture.path.size() };
+			file.write((const char*)&record, sizeof(record));
+			file.write(texture.type.data(), (std::streamsize)texture.type.size());
+			file.write(texture.path.data(), (std::streamsize)texture.path.size());
+			file.write(padding, (std::streamsize)((4 - (texture.type.size() + texture.path.size()) % 4) % 4));
+		}
+	return file.good();
+}
+#endif
\ No newline at end of file
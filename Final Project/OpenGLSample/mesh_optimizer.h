@@ -0,0 +1,227 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// size of the FIFO post-transform cache the optimizer targets and ACMR is measured against
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// average cache miss ratio: vertices shaded per triangle through a FIFO cache of cacheSize entries.
+// 3.0 means nothing is reused, about 0.5-0.7 is typical for a well ordered closed mesh.
+inline float computeACMR(const std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+	// time at which each vertex entered the cache; a FIFO only needs insertion times
+	std::vector<unsigned int> entered(vertexCount, 0);
+	unsigned int misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int vertex = indices[i];
+		if (entered[vertex] == 0 || misses - entered[vertex] + 1 > cacheSize)
+		{
+			misses++;
+			entered[vertex] = misses;
+		}
+	}
+	return (float)misses / (float)(indices.size() / 3);
+}
+
+// Tipsify (Sander, Nehab and Barczak 2007): reorder triangles for the post-transform vertex cache.
+// Fans out from one vertex at a time and picks the next fanning vertex among the ones just emitted that
+// will still be in the cache, so it runs in linear time and needs no per-GPU tuning beyond cacheSize.
+inline void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	// vertex -> triangles adjacency, as offsets into one flat array
+	std::vector<unsigned int> live(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		live[indices[i]]++;
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency(offsets[vertexCount]);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 1;
+	int fanning = 0;
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			for (unsigned int corner = 0; corner < 3; corner++)
+			{
+				unsigned int v = indices[triangle * 3 + corner];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		// best candidate: still has triangles left and will still be cached after they are emitted
+		int next = -1;
+		int bestPriority = -1;
+		for (size_t c = 0; c < candidates.size(); c++)
+		{
+			unsigned int v = candidates[c];
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (int)(time - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = (int)v;
+			}
+		}
+		if (next < 0)
+		{
+			// dead end: back up through recently used vertices, then scan forward for any live one
+			while (!deadEnd.empty() && next < 0)
+			{
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					next = (int)v;
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					next = (int)cursor;
+				cursor++;
+			}
+		}
+		fanning = next;
+	}
+	indices.swap(output);
+}
+
+// renumber vertices in the order the index buffer first uses them, so vertex fetch walks memory
+// forwards; vertices no triangle references are dropped. Run after optimizeVertexCache.
+template <typename VertexT>
+void optimizeVertexFetch(std::vector<VertexT> &vertices, std::vector<unsigned int> &indices)
+{
+	const unsigned int UNUSED = 0xffffffffu;
+	std::vector<unsigned int> remap(vertices.size(), UNUSED);
+	std::vector<VertexT> reordered;
+	reordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int &target = remap[indices[i]];
+		if (target == UNUSED)
+		{
+			target = (unsigned int)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = target;
+	}
+	vertices.swap(reordered);
+}
+
+// merge bitwise identical vertices and rewrite the indices to match. Open-addressing hash over the
+// vertex bytes, so VertexT must have no padding (Vertex is all floats).
+template <typename VertexT>
+void weldVertices(std::vector<VertexT> &vertices, std::vector<unsigned int> &indices)
+{
+	const unsigned int EMPTY = 0xffffffffu;
+	size_t tableSize = 1;
+	while (tableSize < vertices.size() * 2)
+		tableSize <<= 1;
+	std::vector<unsigned int> table(tableSize, EMPTY);
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<VertexT> unique;
+	unique.reserve(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		// 64-bit FNV-1a over the raw bytes
+		const unsigned char *bytes = (const unsigned char*)&vertices[v];
+		unsigned long long hash = 14695981039346656037ull;
+		for (size_t b = 0; b < sizeof(VertexT); b++)
+		{
+			hash ^= bytes[b];
+			hash *= 1099511628211ull;
+		}
+		size_t slot = (size_t)hash & (tableSize - 1);
+		while (table[slot] != EMPTY && std::memcmp(&unique[table[slot]], &vertices[v], sizeof(VertexT)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot] == EMPTY)
+		{
+			table[slot] = (unsigned int)unique.size();
+			unique.push_back(vertices[v]);
+		}
+		remap[v] = table[slot];
+	}
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = remap[indices[i]];
+	vertices.swap(unique);
+}
+
+// what optimizeMesh changed
+struct MeshOptimizeStats
+{
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	size_t triangles = 0;
+
+	// fold another mesh in; the ACMRs are weighted by triangle count, so the sum reads like one mesh
+	void add(const MeshOptimizeStats &other)
+	{
+		size_t total = triangles + other.triangles;
+		if (total > 0)
+		{
+			acmrBefore = (acmrBefore * triangles + other.acmrBefore * other.triangles) / total;
+			acmrAfter = (acmrAfter * triangles + other.acmrAfter * other.triangles) / total;
+		}
+		verticesBefore += other.verticesBefore;
+		verticesAfter += other.verticesAfter;
+		triangles = total;
+	}
+
+	void print(std::ostream &out) const
+	{
+		out << "Mesh optimize: ACMR " << acmrBefore << " -> " << acmrAfter
+			<< ", vertices " << verticesBefore << " -> " << verticesAfter << std::endl;
+	}
+};
+
+// triangle order for the vertex cache, then vertex order for fetch; run before handing the arrays to Mesh
+template <typename VertexT>
+MeshOptimizeStats optimizeMesh(std::vector<VertexT> &vertices, std::vector<unsigned int> &indices)
+{
+	MeshOptimizeStats stats;
+	stats.triangles = indices.size() / 3;
+	stats.verticesBefore = vertices.size();
+	stats.acmrBefore = computeACMR(indices, (unsigned int)vertices.size());
+	optimizeVertexCache(indices, (unsigned int)vertices.size());
+	optimizeVertexFetch(vertices, indices);
+	stats.acmrAfter = computeACMR(indices, (unsigned int)vertices.size());
+	stats.verticesAfter = vertices.size();
+	return stats;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,359 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "cpu_features.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// How each mip level is filtered from the one above it. All of them work on linear values, so sRGB
+// colour is decoded first and encoded again afterwards.
+enum MipFilter {
+	// 2x2 average
+	MIP_FILTER_BOX,
+	// windowed sinc over 12 texels per axis (Kaiser window, alpha 4): sharper distant textures than the box
+	MIP_FILTER_KAISER,
+	// the same with a Lanczos (a = 3) window; a little sharper still, with a little more ringing
+	MIP_FILTER_LANCZOS
+};
+
+// sRGB transfer function tables: 8-bit sRGB to linear, and linear to 8-bit sRGB through 8192 steps, which
+// stays within half a step of the exact encoding even at the dark end
+class SrgbTables
+{
+public:
+	float toLinear[256];
+	unsigned char fromLinear[8192];
+
+	static const SrgbTables &get()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	unsigned char encode(float linear) const
+	{
+		return fromLinear[(int)(std::min(std::max(linear, 0.0f), 1.0f) * 8191.0f + 0.5f)];
+	}
+
+private:
+	SrgbTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 8192; i++)
+		{
+			float l = i / 8191.0f;
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+		}
+	}
+};
+
+// ------------------------------------------------------------------------
+// 2x2 box filter straight on RGBA8, for data that is not sRGB; odd edges repeat their last texel.
+// The reference loop, used for the texels the vector loops leave over.
+inline void downsampleRgbaScalar(const unsigned char *source, int width, int height, unsigned char *destination)
+{
+	int targetWidth = std::max(1, width / 2), targetHeight = std::max(1, height / 2);
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const unsigned char *row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+		const unsigned char *row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+		for (int x = 0; x < targetWidth; x++)
+		{
+			int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+			for (int c = 0; c < 4; c++)
+				destination[((size_t)y * targetWidth + x) * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+#ifdef CPU_FEATURES_X86
+// Each output texel averages a pair from each of two rows. Shuffling even and odd texels apart lines the
+// pairs up, then the sums are done in 16 bits and packed back; the result is exactly the scalar loop's.
+// Both take the first `outputs` texels of an output row, whose source texels must all exist.
+// ------------------------------------------------------------------------
+inline int downsampleRowSse2(const unsigned char *row0, const unsigned char *row1, int outputs, unsigned char *out)
+{
+	const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+	int x = 0;
+	for (; x + 4 <= outputs; x += 4)
+	{
+		__m128 a0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row0 + x * 8)));
+		__m128 b0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16)));
+		__m128 a1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row1 + x * 8)));
+		__m128 b1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16)));
+		__m128i even0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i odd0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+		__m128i even1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i odd1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+		__m128i low = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(even0, zero), _mm_unpacklo_epi8(odd0, zero)),
+			_mm_add_epi16(_mm_unpacklo_epi8(even1, zero), _mm_unpacklo_epi8(odd1, zero)));
+		__m128i high = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(even0, zero), _mm_unpackhi_epi8(odd0, zero)),
+			_mm_add_epi16(_mm_unpackhi_epi8(even1, zero), _mm_unpackhi_epi8(odd1, zero)));
+		low = _mm_srli_epi16(_mm_add_epi16(low, two), 2);
+		high = _mm_srli_epi16(_mm_add_epi16(high, two), 2);
+		_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(low, high));
+	}
+	return x;
+}
+
+// eight texels per step; the 256-bit shuffles and packs stay within 128-bit lanes, so the finished
+// quarters come out as 0 2 1 3 and one permute puts them back in order
+CPU_AVX2_TARGET inline int downsampleRowAvx2(const unsigned char *row0, const unsigned char *row1, int outputs, unsigned char *out)
+{
+	const __m256i zero = _mm256_setzero_si256(), two = _mm256_set1_epi16(2);
+	int x = 0;
+	for (; x + 8 <= outputs; x += 8)
+	{
+		__m256 a0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(row0 + x * 8)));
+		__m256 b0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(row0 + x * 8 + 32)));
+		__m256 a1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(row1 + x * 8)));
+		__m256 b1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(row1 + x * 8 + 32)));
+		__m256i even0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i odd0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+		__m256i even1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i odd1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+		__m256i low = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(even0, zero), _mm256_unpacklo_epi8(odd0, zero)),
+			_mm256_add_epi16(_mm256_unpacklo_epi8(even1, zero), _mm256_unpacklo_epi8(odd1, zero)));
+		__m256i high = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(even0, zero), _mm256_unpackhi_epi8(odd0, zero)),
+			_mm256_add_epi16(_mm256_unpackhi_epi8(even1, zero), _mm256_unpackhi_epi8(odd1, zero)));
+		low = _mm256_srli_epi16(_mm256_add_epi16(low, two), 2);
+		high = _mm256_srli_epi16(_mm256_add_epi16(high, two), 2);
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*)(out + x * 4), packed);
+	}
+	_mm256_zeroupper();
+	return x;
+}
+#endif
+
+// the 2x2 box on RGBA8 (non-sRGB), with the widest vector loop this CPU runs
+inline void downsampleRgba(const unsigned char *source, int width, int height, unsigned char *destination)
+{
+#ifdef CPU_FEATURES_X86
+	if (width < 2)
+	{
+		downsampleRgbaScalar(source, width, height, destination);
+		return;
+	}
+	static const bool avx2 = cpuHasAvx2();
+	int targetWidth = width / 2, targetHeight = std::max(1, height / 2);
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const unsigned char *row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+		const unsigned char *row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+		unsigned char *out = destination + (size_t)y * targetWidth * 4;
+		int x = avx2 ? downsampleRowAvx2(row0, row1, targetWidth, out) : 0;
+		x += downsampleRowSse2(row0 + x * 8, row1 + x * 8, targetWidth - x, out + x * 4);
+		for (; x < targetWidth; x++)
+			for (int c = 0; c < 4; c++)
+				out[x * 4 + c] = (unsigned char)((row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) >> 2);
+	}
+#else
+	downsampleRgbaScalar(source, width, height, destination);
+#endif
+}
+
+// ------------------------------------------------------------------------
+// RGBA8 to float RGBA; sRGB colour is linearized, alpha never is
+inline void rgbaToLinear(const unsigned char *source, size_t texels, bool srgb, float *destination)
+{
+	const SrgbTables &tables = SrgbTables::get();
+	for (size_t i = 0; i < texels * 4; i += 4)
+	{
+		for (int c = 0; c < 3; c++)
+			destination[i + c] = srgb ? tables.toLinear[source[i + c]] : source[i + c] * (1.0f / 255.0f);
+		destination[i + 3] = source[i + 3] * (1.0f / 255.0f);
+	}
+}
+
+inline void linearToRgba(const float *source, size_t texels, bool srgb, unsigned char *destination)
+{
+	const SrgbTables &tables = SrgbTables::get();
+	for (size_t i = 0; i < texels * 4; i += 4)
+	{
+		for (int c = 0; c < 3; c++)
+			destination[i + c] = srgb ? tables.encode(source[i + c]) : (unsigned char)(std::min(std::max(source[i + c], 0.0f), 1.0f) * 255.0f + 0.5f);
+		destination[i + 3] = (unsigned char)(std::min(std::max(source[i + 3], 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+// 2x2 box on float RGBA, one texel per SSE register
+inline void downsampleLinear(const float *source, int width, int height, float *destination)
+{
+	int targetWidth = std::max(1, width / 2), targetHeight = std::max(1, height / 2);
+	for (int y = 0; y < targetHeight; y++)
+	{
+		const float *row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+		const float *row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+		float *out = destination + (size_t)y * targetWidth * 4;
+		for (int x = 0; x < targetWidth; x++)
+		{
+			int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+#ifdef CPU_FEATURES_X86
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)), _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+			_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+			for (int c = 0; c < 4; c++)
+				out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+		}
+	}
+}
+
+// ------------------------------------------------------------------------
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+inline double besselI0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Weights for halving: output texel i sits between source texels 2i and 2i+1, and tap k reads source
+// texel 2i - 5 + k, i.e. offsets -5.5 .. 5.5 source texels, which is +-2.75 in output texels (the sinc's
+// units). Normalized to sum to 1.
+inline std::vector<float> mipFilterTaps(MipFilter filter)
+{
+	const double pi = 3.14159265358979323846, width = 3.0, alpha = 4.0;
+	std::vector<float> taps(12);
+	double total = 0.0;
+	for (int k = 0; k < 12; k++)
+	{
+		double x = (k - 5.5) / 2.0;
+		double sinc = std::sin(pi * x) / (pi * x);
+		double window = filter == MIP_FILTER_LANCZOS ? std::sin(pi * x / width) / (pi * x / width)
+			: besselI0(alpha * std::sqrt(1.0 - (x / width) * (x / width))) / besselI0(alpha);
+		taps[k] = (float)(sinc * window);
+		total += taps[k];
+	}
+	for (int k = 0; k < 12; k++)
+		taps[k] = (float)(taps[k] / total);
+	return taps;
+}
+
+// separable halving with mipFilterTaps on float RGBA: rows into a scratch image, then columns; edges clamp
+inline void resampleLinear(const float *source, int width, int height, const std::vector<float> &taps, float *destination)
+{
+	int targetWidth = std::max(1, width / 2), targetHeight = std::max(1, height / 2);
+	std::vector<float> rows((size_t)targetWidth * height * 4);
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < targetWidth; x++)
+		{
+#ifdef CPU_FEATURES_X86
+			__m128 sum = _mm_setzero_ps();
+			const float *row = source + (size_t)y * width * 4;
+			if (2 * x - 5 >= 0 && 2 * x + 6 < width)
+			{
+				// away from the edges the taps are 12 consecutive texels
+				const float *in = row + (2 * x - 5) * 4;
+				for (int k = 0; k < 12; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps[k]), _mm_loadu_ps(in + k * 4)));
+			}
+			else
+				for (int k = 0; k < 12; k++)
+				{
+					int sx = std::min(std::max(2 * x - 5 + k, 0), width - 1);
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps[k]), _mm_loadu_ps(row + sx * 4)));
+				}
+			_mm_storeu_ps(&rows[((size_t)y * targetWidth + x) * 4], sum);
+#else
+			for (int c = 0; c < 4; c++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < 12; k++)
+					sum += taps[k] * source[((size_t)y * width + std::min(std::max(2 * x - 5 + k, 0), width - 1)) * 4 + c];
+				rows[((size_t)y * targetWidth + x) * 4 + c] = sum;
+			}
+#endif
+		}
+	// columns a whole row at a time, so each of the 12 source rows is read straight through
+	for (int y = 0; y < targetHeight; y++)
+	{
+		float *out = destination + (size_t)y * targetWidth * 4;
+		std::fill(out, out + (size_t)targetWidth * 4, 0.0f);
+		for (int k = 0; k < 12; k++)
+		{
+			const float *in = &rows[(size_t)std::min(std::max(2 * y - 5 + k, 0), height - 1) * targetWidth * 4];
+#ifdef CPU_FEATURES_X86
+			__m128 tap = _mm_set1_ps(taps[k]);
+			for (int x = 0; x < targetWidth; x++)
+				_mm_storeu_ps(out + x * 4, _mm_add_ps(_mm_loadu_ps(out + x * 4), _mm_mul_ps(tap, _mm_loadu_ps(in + x * 4))));
+#else
+			for (size_t i = 0; i < (size_t)targetWidth * 4; i++)
+				out[i] += taps[k] * in[i];
+#endif
+		}
+	}
+}
+
+// stb's 1-4 channels to RGBA8 the way they are sampled: 1 is grey and 2 is grey + alpha, so the
+// luminance goes to RGB; without an alpha channel the texels are opaque
+inline void expandToRgba(const unsigned char *pixels, size_t texels, int channels, unsigned char *rgba)
+{
+	for (size_t p = 0; p < texels; p++)
+	{
+		const unsigned char *in = pixels + p * channels;
+		unsigned char *texel = rgba + p * 4;
+		bool grey = channels < 3;
+		texel[0] = in[0];
+		texel[1] = grey ? in[0] : in[1];
+		texel[2] = grey ? in[0] : in[2];
+		texel[3] = channels == 2 ? in[1] : channels == 4 ? in[3] : 255;
+	}
+}
+
+// RGBA8 copies of every mip level down to 1x1, largest first (see expandToRgba). Plain data with the box
+// filter stays in 8 bits; sRGB colour or the sinc filters go through a linear float copy that is carried
+// from level to level, so each level is rounded to 8 bits only once.
+inline std::vector<std::vector<unsigned char> > buildRgbaMipChain(const unsigned char *pixels, int width, int height, int channels,
+	bool srgb = false, MipFilter filter = MIP_FILTER_BOX)
+{
+	std::vector<std::vector<unsigned char> > mips;
+	std::vector<unsigned char> level((size_t)width * height * 4);
+	expandToRgba(pixels, (size_t)width * height, channels, level.data());
+	mips.push_back(std::move(level));
+
+	std::vector<float> linear, next, taps;
+	bool exact = !srgb && filter == MIP_FILTER_BOX;
+	if (!exact)
+	{
+		linear.resize((size_t)width * height * 4);
+		rgbaToLinear(mips[0].data(), (size_t)width * height, srgb, linear.data());
+		if (filter != MIP_FILTER_BOX)
+			taps = mipFilterTaps(filter);
+	}
+	while (width > 1 || height > 1)
+	{
+		int targetWidth = std::max(1, width / 2), targetHeight = std::max(1, height / 2);
+		std::vector<unsigned char> target((size_t)targetWidth * targetHeight * 4);
+		if (exact)
+			downsampleRgba(mips.back().data(), width, height, target.data());
+		else
+		{
+			next.resize(target.size());
+			if (filter == MIP_FILTER_BOX)
+				downsampleLinear(linear.data(), width, height, next.data());
+			else
+				resampleLinear(linear.data(), width, height, taps, next.data());
+			linearToRgba(next.data(), (size_t)targetWidth * targetHeight, srgb, target.data());
+			linear.swap(next);
+		}
+		mips.push_back(std::move(target));
+		width = targetWidth;
+		height = targetHeight;
+	}
+	return mips;
+}
+#endif
\ No newline at end of file
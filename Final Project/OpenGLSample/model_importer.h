@@ -0,0 +1,146 @@
+#ifndef MODEL_IMPORTER_H
+#define MODEL_IMPORTER_H
+
+#include "mesh.h"
+#include "gltf_importer.h"
+#include "imported_mesh.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "obj_importer.h"
+#include "tangent_space.h"
+#include "thread_pool.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ModelImportOptions
+{
+	MeshStorage storage = MESH_GPU_ONLY;
+	const VertexFormat *format = &VertexFormat::full();
+	// tangent frames for normal mapping; glTF primitives that ship their own keep them
+	bool generateTangents = true;
+	// vertex cache + fetch order (mesh_optimizer.h); the ACMR before and after is printed per model
+	bool optimize = true;
+	// turns a texture path into a GL texture id on the render thread, e.g. Source.cpp's loadTexture;
+	// each distinct path is loaded once per import. Without it textures keep id 0.
+	unsigned int (*loadTexture)(const char *path) = nullptr;
+	// keep a mesh cache (meshCachePath) next to the model: written after every import, and mapped and
+	// uploaded instead of importing while it is not older than the model and has this format. Only
+	// MESH_GPU_ONLY imports read it, the mapped data has no CPU copy to keep.
+	bool cache = true;
+};
+
+// give every texture its GL id, loading each distinct path once per import
+inline void resolveTextures(std::vector<Texture> &textures, std::map<std::string, unsigned int> &textureIds, const ModelImportOptions &options)
+{
+	if (options.loadTexture == nullptr)
+		return;
+	for (size_t t = 0; t < textures.size(); t++)
+	{
+		std::map<std::string, unsigned int>::iterator found = textureIds.find(textures[t].path);
+		if (found == textureIds.end())
+			found = textureIds.insert(std::make_pair(textures[t].path, options.loadTexture(textures[t].path.c_str()))).first;
+		textures[t].id = found->second;
+	}
+}
+
+// the meshes of a fresh cache file, or false (appending nothing) when there is none to use
+inline bool loadModelCache(const char *path, std::vector<Mesh> &meshes, const ModelImportOptions &options)
+{
+	std::string cachePath = meshCachePath(path);
+	long long cacheTime = fileModifiedTime(cachePath);
+	if (cacheTime == 0 || cacheTime < fileModifiedTime(path))
+		return false;
+	MeshCacheFile cache;
+	if (!cache.open(cachePath.c_str()) || cache.format != options.format)
+		return false;
+	std::map<std::string, unsigned int> textureIds;
+	meshes.reserve(meshes.size() + cache.header->submeshCount);
+	for (unsigned int i = 0; i < cache.header->submeshCount; i++)
+	{
+		resolveTextures(cache.textures[i], textureIds, options);
+		meshes.push_back(cache.createMesh(i, std::move(cache.textures[i])));
+	}
+	return true;
+}
+
+// Loads an .obj, .gltf or .glb file and appends one Mesh per submesh / primitive. Parsing, welding,
+// normal and tangent generation and optimization run on ThreadPool::shared(); only the uploads happen on
+// the calling thread, which must own the GL context. With options.cache a fresh mesh cache replaces all
+// of that, and a new one is written after the import.
+inline bool importModel(const char *path, std::vector<Mesh> &meshes, const ModelImportOptions &options = ModelImportOptions())
+{
+	if (options.cache && options.storage == MESH_GPU_ONLY && loadModelCache(path, meshes, options))
+		return true;
+
+	std::string extension = path;
+	extension = extension.substr(std::min(extension.size(), extension.find_last_of('.') + 1));
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+
+	std::vector<ImportedMesh> imported;
+	bool loaded;
+	if (extension == "obj")
+		loaded = importObj(path, imported);
+	else if (extension == "gltf" || extension == "glb")
+		loaded = importGltf(path, imported);
+	else
+	{
+		std::cout << "ERROR::MODEL::unsupported file type: " << path << std::endl;
+		return false;
+	}
+	if (!loaded)
+		return false;
+
+	std::vector<MeshOptimizeStats> optimized(imported.size());
+	ThreadPool::shared().parallelFor(imported.size(), [&imported, &options, &optimized](size_t i)
+	{
+		ImportedMesh &mesh = imported[i];
+		weldVertices(mesh.vertices, mesh.indices);
+		if (!mesh.hasNormals)
+			generateNormals(mesh.vertices, mesh.indices);
+		if (options.generateTangents && !mesh.hasTangents)
+			generateTangents(mesh.vertices, mesh.indices);
+		if (options.optimize)
+			optimized[i] = optimizeMesh(mesh.vertices, mesh.indices);
+	});
+	if (options.optimize)
+	{
+		MeshOptimizeStats stats;
+		for (size_t i = 0; i < optimized.size(); i++)
+			stats.add(optimized[i]);
+		std::cout << path << ": ";
+		stats.print(std::cout);
+	}
+
+	std::map<std::string, unsigned int> textureIds;
+	size_t first = meshes.size();
+	meshes.reserve(meshes.size() + imported.size());
+	for (size_t i = 0; i < imported.size(); i++)
+	{
+		ImportedMesh &mesh = imported[i];
+		if (mesh.indices.empty())
+			continue;
+		resolveTextures(mesh.textures, textureIds, options);
+		// the cache is written from the CPU copy, which is dropped right after when it is not wanted
+		meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), std::move(mesh.textures), options.cache ? MESH_KEEP_CPU_COPY : options.storage, *options.format));
+	}
+	if (options.cache && meshes.size() > first)
+	{
+		std::vector<const Mesh*> written;
+		for (size_t i = first; i < meshes.size(); i++)
+			written.push_back(&meshes[i]);
+		if (!writeMeshCache(meshCachePath(path).c_str(), written))
+			std::cout << "ERROR::MODEL::cannot write the mesh cache for " << path << std::endl;
+		if (options.storage == MESH_GPU_ONLY)
+			for (size_t i = first; i < meshes.size(); i++)
+				meshes[i].releaseCpuCopy();
+	}
+	return true;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free queue for many producers and one consumer (Vyukov's MPSC node queue). push() never
+// blocks and may be called from any thread; pop() belongs to the single consumer, e.g. the render thread
+// draining results from worker threads. T must be default constructible and movable.
+template <typename T>
+class MpscQueue
+{
+public:
+	MpscQueue() : head(&stub), tail(&stub)
+	{
+		stub.next.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~MpscQueue()
+	{
+		T value;
+		while (pop(value))
+		{
+		}
+	}
+
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue &operator=(const MpscQueue &) = delete;
+
+	void push(T &&value)
+	{
+		Node *node = new Node();
+		node->value = std::move(value);
+		enqueue(node);
+	}
+
+	// false when the queue is empty, or when the only remaining item is still being linked in by its
+	// producer; it is returned by a later pop
+	bool pop(T &value)
+	{
+		Node *last = tail;
+		Node *next = last->next.load(std::memory_order_acquire);
+		if (last == &stub)
+		{
+			if (next == nullptr)
+				return false;
+			tail = next;
+			last = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next == nullptr)
+		{
+			if (last != head.load(std::memory_order_acquire))
+				return false;
+			// last is the only node: queue the stub behind it so last can be unlinked
+			enqueue(&stub);
+			next = last->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				return false;
+		}
+		tail = next;
+		value = std::move(last->value);
+		delete last;
+		return true;
+	}
+
+private:
+	struct Node
+	{
+		std::atomic<Node*> next;
+		T value;
+
+		Node() : next(nullptr), value() {}
+	};
+
+	// producers swing head, then link the previous head to the new node
+	std::atomic<Node*> head;
+	// consumer only
+	Node *tail;
+	Node stub;
+
+	void enqueue(Node *node)
+	{
+		node->next.store(nullptr, std::memory_order_relaxed);
+		Node *previous = head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+};
+#endif
\ No newline at end of file
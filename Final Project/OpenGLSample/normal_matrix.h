@@ -0,0 +1,38 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// Returns the matrix that carries normals from object to world space, i.e. transpose(inverse(mat3(model))),
+// computed once per object on the CPU instead of once per vertex in the shader.
+// When the columns of the upper 3x3 are orthogonal the model is a rotation times a (possibly non-uniform)
+// scale, and the inverse-transpose is just each column divided by its squared length; a rigid transform is
+// returned unchanged. Only shears and other general transforms pay for a full inverse.
+inline glm::mat3 normalMatrix(const glm::mat4 &model)
+{
+	const float epsilon = 1e-5f;
+	glm::mat3 m(model);
+
+	float xx = glm::dot(m[0], m[0]);
+	float yy = glm::dot(m[1], m[1]);
+	float zz = glm::dot(m[2], m[2]);
+	if (xx > epsilon && yy > epsilon && zz > epsilon)
+	{
+		float xy = glm::dot(m[0], m[1]);
+		float xz = glm::dot(m[0], m[2]);
+		float yz = glm::dot(m[1], m[2]);
+		bool orthogonal = xy * xy <= epsilon * xx * yy && xz * xz <= epsilon * xx * zz && yz * yz <= epsilon * yy * zz;
+		if (orthogonal)
+		{
+			// rigid: rotation and translation only
+			if (std::fabs(xx - 1.0f) <= epsilon && std::fabs(yy - 1.0f) <= epsilon && std::fabs(zz - 1.0f) <= epsilon)
+				return m;
+			// rotation times scale: (R * S)^-T = R * S^-1
+			return glm::mat3(m[0] / xx, m[1] / yy, m[2] / zz);
+		}
+	}
+	return glm::transpose(glm::inverse(m));
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,384 @@
+#ifndef OBJ_IMPORTER_H
+#define OBJ_IMPORTER_H
+
+#include <glm/glm.hpp>
+
+#include "imported_mesh.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ + MTL. The mapped file is cut into chunks at line breaks and the chunks are tokenized in
+// parallel; a short serial pass then stitches the chunks together and every (group, material) submesh is
+// assembled on its own task. Faces with more than three corners are fan-triangulated.
+struct ObjCorner
+{
+	// 0-based indices, -1 when the corner has no texcoord / normal; relative ones may be negative
+	// until they are rebased on the chunk start (see resolveObjIndex)
+	int position;
+	int texcoord;
+	int normal;
+	// bit n set: component n was a negative (relative) index, stored relative to the chunk start
+	unsigned char chunkRelative;
+};
+
+struct ObjGroupEvent
+{
+	// the event applies from this face of the chunk on
+	size_t face;
+	bool material;
+	std::string name;
+};
+
+struct ObjChunk
+{
+	const char *begin;
+	const char *end;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners;
+	// corners of face f are [faceEnds[f - 1], faceEnds[f])
+	std::vector<unsigned int> faceEnds;
+	std::vector<ObjGroupEvent> events;
+	std::vector<std::string> materialLibraries;
+	size_t badLines = 0;
+	// prefix sums over the previous chunks
+	size_t positionBase = 0;
+	size_t texcoordBase = 0;
+	size_t normalBase = 0;
+};
+
+// ------------------------------------------------------------------------
+// "1/2/3", "1//3", "1/2" or "1"
+inline bool parseObjCorner(const char *begin, const char *end, const ObjChunk &chunk, ObjCorner &corner)
+{
+	TextCursor text = { begin, end };
+	int values[3] = { 0, 0, 0 };
+	for (int component = 0; component < 3 && !text.atEnd(); component++)
+	{
+		if (component > 0)
+		{
+			if (*text.cursor != '/')
+				return false;
+			text.cursor++;
+			if (!text.atEnd() && *text.cursor == '/')
+				continue;
+		}
+		if (!text.parseInt(values[component]) || (component == 0 && values[0] == 0))
+			return false;
+	}
+	if (!text.atEnd() || values[0] == 0)
+		return false;
+
+	size_t counts[3] = { chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size() };
+	int resolved[3];
+	corner.chunkRelative = 0;
+	for (int component = 0; component < 3; component++)
+	{
+		if (values[component] > 0)
+			resolved[component] = values[component] - 1;
+		else if (values[component] < 0)
+		{
+			// may point into an earlier chunk; fixed up once the chunk bases are known
+			resolved[component] = (int)counts[component] + values[component];
+			corner.chunkRelative |= (unsigned char)(1 << component);
+		}
+		else
+			resolved[component] = -1;
+	}
+	corner.position = resolved[0];
+	corner.texcoord = resolved[1];
+	corner.normal = resolved[2];
+	return true;
+}
+
+// ------------------------------------------------------------------------
+// corner component -> index into the stitched attribute array; -1 when the corner has none
+const long long OBJ_BAD_INDEX = -2;
+
+inline long long resolveObjIndex(int index, int chunkRelative, size_t chunkBase, size_t count)
+{
+	if (!chunkRelative && index < 0)
+		return -1;
+	long long resolved = index + (chunkRelative ? (long long)chunkBase : 0);
+	return resolved >= 0 && resolved < (long long)count ? resolved : OBJ_BAD_INDEX;
+}
+
+// ------------------------------------------------------------------------
+inline void parseObjChunk(ObjChunk &chunk)
+{
+	TextCursor text = { chunk.begin, chunk.end };
+	while (!text.atEnd())
+	{
+		std::pair<const char*, const char*> keyword = text.token();
+		if (keyword.first == keyword.second || *keyword.first == '#')
+		{
+			text.skipLine();
+			continue;
+		}
+		bool ok = true;
+		if (tokenIs(keyword, "v"))
+		{
+			// a short line still takes its slot in the numbering, with the missing coordinates at 0
+			glm::vec3 p(0.0f);
+			ok = text.parseFloat(p.x) && text.parseFloat(p.y) && text.parseFloat(p.z);
+			chunk.positions.push_back(p);
+		}
+		else if (tokenIs(keyword, "vt"))
+		{
+			glm::vec2 uv(0.0f);
+			ok = text.parseFloat(uv.x);
+			if (!text.parseFloat(uv.y))
+				uv.y = 0.0f;
+			chunk.texcoords.push_back(uv);
+		}
+		else if (tokenIs(keyword, "vn"))
+		{
+			glm::vec3 n(0.0f);
+			ok = text.parseFloat(n.x) && text.parseFloat(n.y) && text.parseFloat(n.z);
+			chunk.normals.push_back(n);
+		}
+		else if (tokenIs(keyword, "f"))
+		{
+			size_t first = chunk.corners.size();
+			for (;;)
+			{
+				std::pair<const char*, const char*> token = text.token();
+				if (token.first == token.second || *token.first == '#')
+					break;
+				ObjCorner corner;
+				if (!parseObjCorner(token.first, token.second, chunk, corner))
+				{
+					ok = false;
+					break;
+				}
+				chunk.corners.push_back(corner);
+			}
+			if (ok && chunk.corners.size() - first >= 3)
+				chunk.faceEnds.push_back((unsigned int)chunk.corners.size());
+			else
+			{
+				chunk.corners.resize(first);
+				ok = false;
+			}
+		}
+		else if (tokenIs(keyword, "o") || tokenIs(keyword, "g"))
+		{
+			ObjGroupEvent event = { chunk.faceEnds.size(), false, text.restOfLine() };
+			chunk.events.push_back(event);
+		}
+		else if (tokenIs(keyword, "usemtl"))
+		{
+			ObjGroupEvent event = { chunk.faceEnds.size(), true, text.restOfLine() };
+			chunk.events.push_back(event);
+		}
+		else if (tokenIs(keyword, "mtllib"))
+			chunk.materialLibraries.push_back(text.restOfLine());
+		// s, l, p, vp and friends are ignored
+
+		if (!ok)
+			chunk.badLines++;
+		text.skipLine();
+	}
+}
+
+// ------------------------------------------------------------------------
+// newmtl blocks -> texture lists; only the maps the lighting shaders sample are kept
+inline void parseObjMaterials(const std::string &path, std::map<std::string, std::vector<Texture> > &materials)
+{
+	MappedFile file;
+	if (!file.open(path.c_str()))
+	{
+		std::cout << "ERROR::OBJ::missing material library: " << path << std::endl;
+		return;
+	}
+	const std::string directory = directoryOf(path);
+	std::vector<Texture> *current = nullptr;
+	TextCursor text = { (const char*)file.data(), (const char*)file.data() + file.size() };
+	while (!text.atEnd())
+	{
+		std::pair<const char*, const char*> keyword = text.token();
+		const char *type = nullptr;
+		if (tokenIs(keyword, "newmtl"))
+			current = &materials[text.restOfLine()];
+		else if (tokenIs(keyword, "map_Kd"))
+			type = "texture_diffuse";
+		else if (tokenIs(keyword, "map_Ks"))
+			type = "texture_specular";
+		else if (tokenIs(keyword, "map_Bump") || tokenIs(keyword, "map_bump") || tokenIs(keyword, "bump") || tokenIs(keyword, "norm"))
+			type = "texture_normal";
+		else if (tokenIs(keyword, "disp") || tokenIs(keyword, "map_disp"))
+			type = "texture_height";
+
+		if (type != nullptr && current != nullptr)
+		{
+			// options such as "-bm 1.0" come first; the file name is the last token
+			std::string arguments = text.restOfLine();
+			size_t start = arguments.find_last_of(" \t");
+			Texture texture;
+			texture.id = 0;
+			texture.type = type;
+			texture.path = directory + (start == std::string::npos ? arguments : arguments.substr(start + 1));
+			current->push_back(texture);
+		}
+		text.skipLine();
+	}
+}
+
+// ------------------------------------------------------------------------
+inline bool importObj(const char *path, std::vector<ImportedMesh> &meshes)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cout << "ERROR::OBJ::cannot open: " << path << std::endl;
+		return false;
+	}
+	ThreadPool &pool = ThreadPool::shared();
+	const char *data = (const char*)file.data();
+	const char *dataEnd = data + file.size();
+
+	// chunks of at least 1 MB, a few per worker so uneven chunks still balance
+	const size_t MIN_CHUNK_BYTES = 1 << 20;
+	size_t chunkCount = file.size() / MIN_CHUNK_BYTES;
+	if (chunkCount > pool.size() * 4)
+		chunkCount = pool.size() * 4;
+	if (chunkCount == 0)
+		chunkCount = 1;
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char *cursor = data;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		chunks[i].begin = cursor;
+		const char *split = i + 1 == chunkCount ? dataEnd : data + file.size() / chunkCount * (i + 1);
+		if (split < cursor)
+			split = cursor;
+		while (split < dataEnd && split[-1] != '\n')
+			split++;
+		chunks[i].end = split;
+		cursor = split;
+	}
+	pool.parallelFor(chunkCount, [&chunks](size_t i) { parseObjChunk(chunks[i]); });
+
+	// stitch: global attribute arrays, chunk bases, material libraries
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> normals;
+	std::map<std::string, std::vector<Texture> > materials;
+	size_t badLines = 0;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		ObjChunk &chunk = chunks[i];
+		chunk.positionBase = positions.size();
+		chunk.texcoordBase = texcoords.size();
+		chunk.normalBase = normals.size();
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		for (size_t l = 0; l < chunk.materialLibraries.size(); l++)
+			parseObjMaterials(directoryOf(path) + chunk.materialLibraries[l], materials);
+		badLines += chunk.badLines;
+		std::vector<glm::vec3>().swap(chunk.positions);
+		std::vector<glm::vec2>().swap(chunk.texcoords);
+		std::vector<glm::vec3>().swap(chunk.normals);
+	}
+	if (badLines > 0)
+		std::cout << "ERROR::OBJ::skipped " << badLines << " malformed lines: " << path << std::endl;
+
+	// runs of faces between group / material changes, collected per (group, material) submesh
+	struct FaceRun { size_t chunk, first, last; };
+	std::map<std::pair<std::string, std::string>, size_t> submeshIds;
+	std::vector<std::vector<FaceRun> > submeshRuns;
+	std::vector<std::pair<std::string, std::string> > submeshKeys;
+	std::string group, material;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const ObjChunk &chunk = chunks[i];
+		size_t face = 0;
+		for (size_t e = 0; e <= chunk.events.size(); e++)
+		{
+			size_t runEnd = e < chunk.events.size() ? chunk.events[e].face : chunk.faceEnds.size();
+			if (runEnd > face)
+			{
+				std::pair<std::string, std::string> key(group, material);
+				std::map<std::pair<std::string, std::string>, size_t>::iterator found = submeshIds.find(key);
+				if (found == submeshIds.end())
+				{
+					found = submeshIds.insert(std::make_pair(key, submeshRuns.size())).first;
+					submeshRuns.push_back(std::vector<FaceRun>());
+					submeshKeys.push_back(key);
+				}
+				FaceRun run = { i, face, runEnd };
+				submeshRuns[found->second].push_back(run);
+				face = runEnd;
+			}
+			if (e < chunk.events.size())
+				(chunk.events[e].material ? material : group) = chunk.events[e].name;
+		}
+	}
+
+	// one task per submesh: resolve the corners into vertices and fan-triangulate; identical corners
+	// are merged afterwards by weldVertices
+	size_t firstMesh = meshes.size();
+	meshes.resize(firstMesh + submeshRuns.size());
+	pool.parallelFor(submeshRuns.size(), [&](size_t s)
+	{
+		ImportedMesh &mesh = meshes[firstMesh + s];
+		mesh.name = submeshKeys[s].first;
+		std::map<std::string, std::vector<Texture> >::const_iterator textures = materials.find(submeshKeys[s].second);
+		if (textures != materials.end())
+			mesh.textures = textures->second;
+		mesh.hasNormals = true;
+		for (size_t r = 0; r < submeshRuns[s].size(); r++)
+		{
+			const FaceRun &run = submeshRuns[s][r];
+			const ObjChunk &chunk = chunks[run.chunk];
+			for (size_t f = run.first; f < run.last; f++)
+			{
+				unsigned int begin = f == 0 ? 0 : chunk.faceEnds[f - 1];
+				unsigned int end = chunk.faceEnds[f];
+				unsigned int base = (unsigned int)mesh.vertices.size();
+				bool valid = true;
+				for (unsigned int c = begin; c < end && valid; c++)
+				{
+					const ObjCorner &corner = chunk.corners[c];
+					long long p = resolveObjIndex(corner.position, corner.chunkRelative & 1, chunk.positionBase, positions.size());
+					long long t = resolveObjIndex(corner.texcoord, corner.chunkRelative & 2, chunk.texcoordBase, texcoords.size());
+					long long n = resolveObjIndex(corner.normal, corner.chunkRelative & 4, chunk.normalBase, normals.size());
+					if (p < 0 || t == OBJ_BAD_INDEX || n == OBJ_BAD_INDEX)
+					{
+						valid = false;
+						break;
+					}
+					Vertex vertex = Vertex();
+					vertex.Position = positions[(size_t)p];
+					if (t >= 0)
+						vertex.TexCoords = texcoords[(size_t)t];
+					if (n >= 0)
+						vertex.Normal = normals[(size_t)n];
+					else
+						mesh.hasNormals = false;
+					mesh.vertices.push_back(vertex);
+				}
+				if (!valid)
+				{
+					mesh.vertices.resize(base);
+					continue;
+				}
+				for (unsigned int c = 2; c < end - begin; c++)
+				{
+					mesh.indices.push_back(base);
+					mesh.indices.push_back(base + c - 1);
+					mesh.indices.push_back(base + c);
+				}
+			}
+		}
+	});
+	return true;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef PARALLEL_COMPILE_H
+#define PARALLEL_COMPILE_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+// GL_KHR_parallel_shader_compile is not part of the generated glad loader, so its enums and
+// entry point are declared here and loaded by hand in ParallelShaderCompile::enable()
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_PRIVATE)(GLuint count);
+
+// Lets the driver compile and link on its own threads. Once enabled, GL_COMPLETION_STATUS_KHR can be
+// polled without blocking; without the extension every status query waits for the compile to finish.
+class ParallelShaderCompile
+{
+public:
+	// call once after gladLoadGLLoader with the same loader; returns whether the extension is in use
+	static bool enable(GLADloadproc load)
+	{
+		if (!hasGLExtension("GL_KHR_parallel_shader_compile") && !hasGLExtension("GL_ARB_parallel_shader_compile"))
+			return false;
+		PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_PRIVATE maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_PRIVATE)load("glMaxShaderCompilerThreadsKHR");
+		if (maxThreads == NULL)
+			maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_PRIVATE)load("glMaxShaderCompilerThreadsARB");
+		if (maxThreads == NULL)
+			return false;
+		// 0xFFFFFFFF lets the implementation pick how many threads to use
+		maxThreads(0xFFFFFFFFu);
+		active() = true;
+		return true;
+	}
+
+	// true when GL_COMPLETION_STATUS_KHR may be queried
+	static bool available()
+	{
+		return active();
+	}
+
+	// has this program (and all of its shaders) finished linking? never blocks when available()
+	static bool programDone(GLuint program)
+	{
+		if (!available())
+			return true;
+		GLint done = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+
+private:
+	static bool &active()
+	{
+		static bool enabled = false;
+		return enabled;
+	}
+};
+#endif
\ No newline at end of file
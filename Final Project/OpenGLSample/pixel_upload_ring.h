@@ -0,0 +1,164 @@
+#ifndef PIXEL_UPLOAD_RING_H
+#define PIXEL_UPLOAD_RING_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+struct PixelUploadStats
+{
+	unsigned int uploads = 0;
+	unsigned long long bytes = 0;
+	// uploads that found their slot still in use by the GPU, and how long they waited for it
+	unsigned int stalls = 0;
+	double stallMilliseconds = 0.0;
+	unsigned int frames = 0;
+	unsigned long long lastFrameBytes = 0;
+	unsigned long long worstFrameBytes = 0;
+};
+
+// Streams texture data through a ring of pixel unpack buffers. upload() copies the pixels into the next
+// buffer and issues glTexSubImage2D from it, so the driver DMAs from the buffer while the CPU moves on
+// instead of copying client memory inside the call. Each slot is fenced after use and waited on before it
+// is written again, which is the only place the CPU can stall; with enough slots it never does.
+// The context is GL 3.3, without glBufferStorage, so slots are mapped per upload with glMapBufferRange
+// rather than persistently; the fence makes GL_MAP_UNSYNCHRONIZED_BIT safe, so mapping does not sync.
+class PixelUploadRing
+{
+public:
+	PixelUploadStats stats;
+
+	explicit PixelUploadRing(unsigned int slotCount = 4) : slots(slotCount), next(0), frameBytes(0) {}
+
+	// Fills the bound GL_TEXTURE_2D's `level`, whose storage must already be allocated, from `pixels`.
+	// Rows are read tightly packed (GL_UNPACK_ALIGNMENT 1).
+	// ------------------------------------------------------------------------
+	void upload(GLint level, int width, int height, GLenum format, const void *pixels, size_t bytes)
+	{
+		stream(pixels, bytes, [&](const unsigned char *source)
+		{
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, source);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		});
+	}
+
+	// Copies `bytes` of data into a slot and calls issue(source) with the unpack buffer bound, where source
+	// is the data's start as a buffer offset; issue may make several glTex*/glCompressedTex* calls from it.
+	// If no slot can be mapped, issue gets the client pointer and no unpack buffer instead.
+	// ------------------------------------------------------------------------
+	template <typename Issue>
+	void stream(const void *data, size_t bytes, Issue issue)
+	{
+		Slot &slot = slots[next];
+		next = (next + 1) % slots.size();
+		waitFor(slot);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer == 0 ? create(slot) : slot.buffer);
+		if (bytes > slot.capacity)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+			slot.capacity = bytes;
+		}
+		void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (mapped == nullptr)
+		{
+			// no buffer to stream through; upload from client memory instead
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			issue((const unsigned char*)data);
+			count(bytes);
+			return;
+		}
+		std::memcpy(mapped, data, bytes);
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE)
+			std::cout << "ERROR::PIXEL_UPLOAD::buffer contents lost while mapped" << std::endl;
+
+		// with an unpack buffer bound the data argument is an offset into it
+		issue((const unsigned char*)0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		// everything else in the program passes client pointers to glTex*Image
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		count(bytes);
+	}
+
+	// closes the frame's byte count; call once per frame after the uploads
+	// ------------------------------------------------------------------------
+	void endFrame()
+	{
+		stats.frames++;
+		stats.lastFrameBytes = frameBytes;
+		if (frameBytes > stats.worstFrameBytes)
+			stats.worstFrameBytes = frameBytes;
+		frameBytes = 0;
+	}
+
+	// ------------------------------------------------------------------------
+	void release()
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			if (slots[i].fence != nullptr)
+				glDeleteSync(slots[i].fence);
+			if (slots[i].buffer != 0)
+				glDeleteBuffers(1, &slots[i].buffer);
+			slots[i] = Slot();
+		}
+		next = 0;
+	}
+
+	void printStats(std::ostream &out) const
+	{
+		out << "Pixel upload ring: " << stats.uploads << " uploads, " << stats.bytes / (1024 * 1024) << " MB over " << stats.frames
+			<< " frames (" << stats.worstFrameBytes / 1024 << " KB worst frame), " << stats.stalls << " stalls totalling "
+			<< stats.stallMilliseconds << " ms" << std::endl;
+	}
+
+private:
+	struct Slot
+	{
+		GLuint buffer = 0;
+		size_t capacity = 0;
+		// signalled once the GPU has finished reading the buffer
+		GLsync fence = nullptr;
+	};
+
+	std::vector<Slot> slots;
+	size_t next;
+	unsigned long long frameBytes;
+
+	static GLuint create(Slot &slot)
+	{
+		glGenBuffers(1, &slot.buffer);
+		return slot.buffer;
+	}
+
+	// ------------------------------------------------------------------------
+	void waitFor(Slot &slot)
+	{
+		if (slot.fence == nullptr)
+			return;
+		GLenum result = glClientWaitSync(slot.fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			do
+				result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			while (result == GL_TIMEOUT_EXPIRED);
+			stats.stalls++;
+			stats.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+	}
+
+	void count(size_t bytes)
+	{
+		stats.uploads++;
+		stats.bytes += bytes;
+		frameBytes += bytes;
+	}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of every shader source as read (before any defines are injected), the
+// permutation key() the defines come from, and the driver's vendor, renderer and version strings, so a
+// source edit or driver update simply misses and the program is compiled from source again.
+// Link programs with prepare() called first, otherwise the driver may not keep a retrievable binary.
+class ProgramBinaryCache
+{
+public:
+	// folder the binaries are written to, relative to the working directory
+	static std::string &directory()
+	{
+		static std::string dir = "shadercache";
+		return dir;
+	}
+
+	// program binaries are core since 4.1 and may still report zero formats
+	static bool supported()
+	{
+		if (glProgramBinary == NULL || glGetProgramBinary == NULL)
+			return false;
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	// 64-bit FNV-1a over the sources, the permutation mask and the driver identification
+	static unsigned long long key(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode, unsigned int permutation)
+	{
+		unsigned long long hash = 14695981039346656037ull;
+		hashString(hash, vertexCode);
+		hashString(hash, fragmentCode);
+		hashString(hash, geometryCode);
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			hash ^= (permutation >> shift) & 0xffu;
+			hash *= 1099511628211ull;
+		}
+		hashString(hash, glString(GL_VENDOR));
+		hashString(hash, glString(GL_RENDERER));
+		hashString(hash, glString(GL_VERSION));
+		return hash;
+	}
+
+	// ask the driver to keep the binary of a program that is about to be linked
+	static void prepare(GLuint program)
+	{
+		if (supported())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// try to link program from a cached binary; false means compile from source as usual
+	static bool load(GLuint program, unsigned long long key)
+	{
+		if (!supported())
+			return false;
+		std::ifstream file(path(key).c_str(), std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		Header header;
+		if (!file.read((char*)&header, sizeof(Header)) || header.magic != MAGIC || header.version != VERSION || header.key != key)
+			return false;
+		// the length comes from disk, so a corrupt file must not turn into a huge allocation
+		std::streamoff start = file.tellg();
+		file.seekg(0, std::ios::end);
+		std::streamoff remaining = file.tellg() - start;
+		file.seekg(start);
+		if (header.length == 0 || (std::streamoff)header.length > remaining)
+			return false;
+		std::vector<char> binary(header.length);
+		if (!file.read(&binary[0], header.length))
+			return false;
+
+		glProgramBinary(program, header.format, &binary[0], (GLsizei)header.length);
+		GLint success = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		// a rejected binary (e.g. after a driver update with identical strings) is overwritten on the next store()
+		return success == GL_TRUE;
+	}
+
+	// write a successfully linked program to the cache
+	static void store(GLuint program, unsigned long long key)
+	{
+		if (!supported())
+			return;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		Header header;
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.key = key;
+		std::vector<char> binary(length);
+		GLsizei written = 0;
+		glGetProgramBinary(program, length, &written, &header.format, &binary[0]);
+		if (written <= 0)
+			return;
+		header.length = (unsigned int)written;
+
+		makeDirectory(directory());
+		std::ofstream file(path(key).c_str(), std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return;
+		file.write((const char*)&header, sizeof(Header));
+		file.write(&binary[0], written);
+	}
+
+private:
+	static const unsigned int MAGIC = 0x42505347; // "GSPB"
+	static const unsigned int VERSION = 1;
+
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned long long key;
+		GLenum format;
+		unsigned int length;
+	};
+
+	static void hashString(unsigned long long &hash, const std::string &text)
+	{
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			hash ^= (unsigned char)text[i];
+			hash *= 1099511628211ull;
+		}
+		// separator, so moving text between two stages changes the key
+		hash ^= 0xff;
+		hash *= 1099511628211ull;
+	}
+
+	static std::string glString(GLenum name)
+	{
+		const GLubyte *value = glGetString(name);
+		return value ? std::string((const char*)value) : std::string();
+	}
+
+	static std::string path(unsigned long long key)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", key);
+		return directory() + "/" + name;
+	}
+
+	static void makeDirectory(const std::string &dir)
+	{
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+};
+#endif
\ No newline at end of file
@@ -5,18 +5,57 @@
 
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+#include "program_cache.h"
+#include "parallel_compile.h"
+
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+// a uniform location resolved once from the program's reflected uniform table.
+// Resolve handles after construction and reuse them every frame; a handle for a
+// name the program does not use holds location -1 and every set on it is a no-op.
+struct UniformHandle
+{
+	GLint location = -1;
+	// slot in the shader's value shadow
+	int index = -1;
+
+	bool valid() const { return location >= 0; }
+};
+
+// permutation key of a program built without an injected permutation; no LightingPermutation::key()
+// reaches it (see shader_permutation.h)
+const unsigned int NO_PERMUTATION = 0xffffffffu;
+
+// COMPILE_BLOCKING finishes the program inside the constructor. COMPILE_ASYNC only submits the
+// compile and link; poll ready() each frame and draw with a fallback program until it returns true.
+enum ShaderCompileMode {
+	COMPILE_BLOCKING,
+	COMPILE_ASYNC
+};
+
 class Shader
 {
 public:
 	unsigned int ID;
+	// source files this program was built from (empty for fromSource programs)
+	std::string vertexPath, fragmentPath, geometryPath;
+	// preprocessor block injected after the #version line of every stage, and the key() of the
+	// permutation it was generated from; the program binary cache keys on the latter, so equal
+	// permutations must mean equal defines (see shader_permutation.h)
+	std::string defines;
+	unsigned int permutation = NO_PERMUTATION;
+	// bumped every time reload() replaces the program; handles and per-program GL state
+	// (sampler units, uniform block bindings) resolved under an older generation are stale
+	unsigned int generation = 0;
 	// constructor generates the shader on the fly
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, ShaderCompileMode mode = COMPILE_BLOCKING, unsigned int permutation = NO_PERMUTATION, const std::string &defines = std::string())
+		: vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : ""), defines(defines), permutation(permutation)
 	{
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
@@ -58,114 +97,438 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
+		build(vertexCode, fragmentCode, geometryCode, mode);
+	}
+	// generates the shader from in-memory source code instead of files
+	// ------------------------------------------------------------------------
+	static Shader fromSource(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode = std::string(), ShaderCompileMode mode = COMPILE_BLOCKING, unsigned int permutation = NO_PERMUTATION, const std::string &defines = std::string())
+	{
+		Shader shader;
+		shader.defines = defines;
+		shader.permutation = permutation;
+		shader.build(vertexCode, fragmentCode, geometryCode, mode);
+		return shader;
+	}
+	// has the program finished compiling and linked successfully? With GL_KHR_parallel_shader_compile
+	// this never blocks; without it the first call waits for the driver. Errors are reported once.
+	// ------------------------------------------------------------------------
+	bool ready()
+	{
+		if (!pending)
+			return linked;
+		if (!ParallelShaderCompile::programDone(ID))
+			return false;
+		return finish();
+	}
+	// collect the compile and link result now, waiting for the driver if it is still working; this is
+	// what COMPILE_BLOCKING does at construction. Returns whether the program linked.
+	// ------------------------------------------------------------------------
+	bool finish()
+	{
+		if (!pending)
+			return linked;
+		pending = false;
 		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
 		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
-		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
+		if (geometry != 0)
 			checkCompileErrors(geometry, "GEOMETRY");
-		}
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
+		linked = checkCompileErrors(ID, "PROGRAM");
+		if (linked)
+			ProgramBinaryCache::store(ID, cacheKey);
 		// delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
+		if (geometry != 0)
 			glDeleteShader(geometry);
-
+		vertex = fragment = geometry = 0;
+		// 3. reflect every active uniform once so the setters never ask the driver again
+		reflectUniforms();
+		return linked;
+	}
+	// rebuild the program from its files. The new program replaces ID only if it links; on a
+	// compile or link error the errors are printed and the old program keeps drawing. Blocking,
+	// so call it between frames.
+	// ------------------------------------------------------------------------
+	bool reload()
+	{
+		if (vertexPath.empty())
+			return false;
+		Shader replacement(vertexPath.c_str(), fragmentPath.c_str(), geometryPath.empty() ? nullptr : geometryPath.c_str(), COMPILE_BLOCKING, permutation, defines);
+		if (!replacement.linked)
+		{
+			glDeleteProgram(replacement.ID);
+			return false;
+		}
+		// an async build of the old program may still own its stages
+		if (vertex != 0)
+			glDeleteShader(vertex);
+		if (fragment != 0)
+			glDeleteShader(fragment);
+		if (geometry != 0)
+			glDeleteShader(geometry);
+		GLState::get().forgetProgram(ID);
+		glDeleteProgram(ID);
+		unsigned int next = generation + 1;
+		// takes the new ID, uniform table and fresh value shadow in one step
+		*this = replacement;
+		generation = next;
+		return true;
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use()
 	{
-		glUseProgram(ID);
+		GLState::get().useProgram(ID);
+	}
+	// attach a named uniform block to a buffer binding point; programs without the block are left alone
+	// ------------------------------------------------------------------------
+	void bindUniformBlock(const char *blockName, GLuint binding) const
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(ID, blockName);
+		if (blockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, blockIndex, binding);
+	}
+	// resolve a uniform name against the reflected table (no driver round-trip)
+	// ------------------------------------------------------------------------
+	UniformHandle uniform(const char *name) const
+	{
+		UniformHandle handle;
+		if (uniformTable.empty())
+			return handle;
+		unsigned int hash = hashName(name);
+		unsigned int mask = (unsigned int)uniformTable.size() - 1;
+		for (unsigned int i = hash & mask; uniformTable[i].used; i = (i + 1) & mask)
+		{
+			if (uniformTable[i].hash == hash && uniformTable[i].name == name)
+			{
+				handle.location = uniformTable[i].location;
+				handle.index = uniformTable[i].index;
+				break;
+			}
+		}
+		return handle;
+	}
+	// utility uniform functions taking a resolved handle; values equal to the
+	// last upload to the same location are dropped by the state cache
+	// ------------------------------------------------------------------------
+	void setBool(UniformHandle uniform, bool value) const
+	{
+		setInt(uniform, (int)value);
 	}
-	// utility uniform functions
 	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
+	void setInt(UniformHandle uniform, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		if (changed(uniform, &value, sizeof(value)))
+			glUniform1i(uniform.location, value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
+	void setFloat(UniformHandle uniform, float value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		if (changed(uniform, &value, sizeof(value)))
+			glUniform1f(uniform.location, value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
+	void setVec2(UniformHandle uniform, const glm::vec2 &value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		if (changed(uniform, &value[0], sizeof(glm::vec2)))
+			glUniform2fv(uniform.location, 1, &value[0]);
+	}
+	void setVec2(UniformHandle uniform, float x, float y) const
+	{
+		setVec2(uniform, glm::vec2(x, y));
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setVec3(UniformHandle uniform, const glm::vec3 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		if (changed(uniform, &value[0], sizeof(glm::vec3)))
+			glUniform3fv(uniform.location, 1, &value[0]);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setVec3(UniformHandle uniform, float x, float y, float z) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		setVec3(uniform, glm::vec3(x, y, z));
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setVec4(UniformHandle uniform, const glm::vec4 &value) const
+	{
+		if (changed(uniform, &value[0], sizeof(glm::vec4)))
+			glUniform4fv(uniform.location, 1, &value[0]);
+	}
+	void setVec4(UniformHandle uniform, float x, float y, float z, float w) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec4(uniform, glm::vec4(x, y, z, w));
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	// ------------------------------------------------------------------------
+	void setMat2(UniformHandle uniform, const glm::mat2 &mat) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		if (changed(uniform, &mat[0][0], sizeof(glm::mat2)))
+			glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setMat3(UniformHandle uniform, const glm::mat3 &mat) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		if (changed(uniform, &mat[0][0], sizeof(glm::mat3)))
+			glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w)
+	// ------------------------------------------------------------------------
+	void setMat4(UniformHandle uniform, const glm::mat4 &mat) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		if (changed(uniform, &mat[0][0], sizeof(glm::mat4)))
+			glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
 	}
+	// utility uniform functions taking a name; these look the name up in the
+	// cached table, so string literals cost one hash and no allocation
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setBool(const char *name, bool value) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setBool(uniform(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setInt(const char *name, int value) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setInt(uniform(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setFloat(const char *name, float value) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setFloat(uniform(name), value);
+	}
+	// ------------------------------------------------------------------------
+	void setVec2(const char *name, const glm::vec2 &value) const
+	{
+		setVec2(uniform(name), value);
+	}
+	void setVec2(const char *name, float x, float y) const
+	{
+		setVec2(uniform(name), x, y);
+	}
+	// ------------------------------------------------------------------------
+	void setVec3(const char *name, const glm::vec3 &value) const
+	{
+		setVec3(uniform(name), value);
+	}
+	void setVec3(const char *name, float x, float y, float z) const
+	{
+		setVec3(uniform(name), x, y, z);
+	}
+	// ------------------------------------------------------------------------
+	void setVec4(const char *name, const glm::vec4 &value) const
+	{
+		setVec4(uniform(name), value);
+	}
+	void setVec4(const char *name, float x, float y, float z, float w) const
+	{
+		setVec4(uniform(name), x, y, z, w);
+	}
+	// ------------------------------------------------------------------------
+	void setMat2(const char *name, const glm::mat2 &mat) const
+	{
+		setMat2(uniform(name), mat);
+	}
+	// ------------------------------------------------------------------------
+	void setMat3(const char *name, const glm::mat3 &mat) const
+	{
+		setMat3(uniform(name), mat);
+	}
+	// ------------------------------------------------------------------------
+	void setMat4(const char *name, const glm::mat4 &mat) const
+	{
+		setMat4(uniform(name), mat);
+	}
+	// list the uniforms the scene code keeps re-uploading with an unchanged value
+	// ------------------------------------------------------------------------
+	void printRedundantUniforms(std::ostream &out) const
+	{
+		for (size_t i = 0; i < uniformShadows.size(); i++)
+			if (uniformShadows[i].redundant > 0)
+				out << "  " << uniformNames[i] << ": " << uniformShadows[i].redundant << " redundant sets" << std::endl;
 	}
 
 private:
-	// utility function for checking shader compilation/linking errors.
+	Shader() : ID(0) {}
+
+	// compile and link the program from source; see ready() for how the result is collected
+	// ------------------------------------------------------------------------
+	void build(const std::string &vertexSource, const std::string &fragmentSource, const std::string &geometrySource, ShaderCompileMode mode)
+	{
+		std::string vertexCode = injectDefines(vertexSource);
+		std::string fragmentCode = injectDefines(fragmentSource);
+		std::string geometryCode = geometrySource.empty() ? geometrySource : injectDefines(geometrySource);
+		const char* vShaderCode = vertexCode.c_str();
+		const char * fShaderCode = fragmentCode.c_str();
+		// a cached binary of exactly these sources and permutation on this driver skips compilation entirely
+		cacheKey = ProgramBinaryCache::key(vertexSource, fragmentSource, geometrySource, permutation);
+		ID = glCreateProgram();
+		if (ProgramBinaryCache::load(ID, cacheKey))
+		{
+			linked = true;
+			reflectUniforms();
+			return;
+		}
+		// 2. compile shaders; no status is queried here, so the driver is free to
+		// compile every stage (and other programs) in parallel until ready() asks
+		// vertex shader
+		vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glCompileShader(vertex);
+		// fragment Shader
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glCompileShader(fragment);
+		// if geometry shader is given, compile geometry shader
+		if (!geometryCode.empty())
+		{
+			const char * gShaderCode = geometryCode.c_str();
+			geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(geometry, 1, &gShaderCode, NULL);
+			glCompileShader(geometry);
+		}
+		// shader Program
+		ProgramBinaryCache::prepare(ID);
+		glAttachShader(ID, vertex);
+		glAttachShader(ID, fragment);
+		if (geometry != 0)
+			glAttachShader(ID, geometry);
+		glLinkProgram(ID);
+		pending = true;
+		// not ready(): with parallel compile enabled it would return at once while the link runs
+		if (mode == COMPILE_BLOCKING)
+			finish();
+	}
+
+	// #version has to stay the first directive, so the defines go on the line after it
+	// ------------------------------------------------------------------------
+	std::string injectDefines(const std::string &source) const
+	{
+		if (defines.empty())
+			return source;
+		size_t version = source.find("#version");
+		if (version == std::string::npos)
+			return defines + source;
+		size_t lineEnd = source.find('\n', version);
+		if (lineEnd == std::string::npos)
+			return source + "\n" + defines;
+		return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+	}
+
+	// compile state between submission and ready()
+	unsigned int vertex = 0, fragment = 0, geometry = 0;
+	unsigned long long cacheKey = 0;
+	bool pending = false;
+	bool linked = false;
+
+	// flat open-addressing table of every active uniform, filled once after link
+	struct UniformSlot
+	{
+		bool used = false;
+		unsigned int hash = 0;
+		GLint location = -1;
+		int index = -1;
+		std::string name;
+	};
+	std::vector<UniformSlot> uniformTable;
+	// last uploaded value per reflected uniform, indexed by UniformHandle::index
+	mutable std::vector<UniformShadow> uniformShadows;
+	std::vector<std::string> uniformNames;
+
+	// filter an upload through the state cache; unknown uniforms are never uploaded
+	// ------------------------------------------------------------------------
+	bool changed(UniformHandle uniform, const void *value, size_t bytes) const
+	{
+		if (uniform.index < 0)
+			return false;
+		return GLState::get().uniformChanged(uniformShadows[uniform.index], value, bytes);
+	}
+
+	// FNV-1a over the uniform name
+	// ------------------------------------------------------------------------
+	static unsigned int hashName(const char *name)
+	{
+		unsigned int hash = 2166136261u;
+		while (*name)
+		{
+			hash ^= (unsigned char)*name++;
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+	// ------------------------------------------------------------------------
+	void insertUniform(const std::string &name, GLint location, int index)
+	{
+		unsigned int hash = hashName(name.c_str());
+		unsigned int mask = (unsigned int)uniformTable.size() - 1;
+		unsigned int i = hash & mask;
+		while (uniformTable[i].used && uniformTable[i].name != name)
+			i = (i + 1) & mask;
+		uniformTable[i].used = true;
+		uniformTable[i].hash = hash;
+		uniformTable[i].location = location;
+		uniformTable[i].index = index;
+		uniformTable[i].name = name;
+	}
+	// query all active uniforms through glGetProgramiv(GL_ACTIVE_UNIFORMS) and build the table.
+	// arrays of plain types are reported once as "name[0]", so every element and the bare
+	// array name are registered as well; uniform block members have no location and are skipped.
+	// ------------------------------------------------------------------------
+	void reflectUniforms()
+	{
+		uniformTable.clear();
+		uniformShadows.clear();
+		uniformNames.clear();
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		if (count <= 0 || maxLength <= 0)
+			return;
+
+		struct Entry
+		{
+			std::string name;
+			GLint location;
+			int index;
+		};
+		std::vector<Entry> entries;
+		std::vector<GLchar> nameBuffer(maxLength);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &nameBuffer[0]);
+			std::string name(&nameBuffer[0], length);
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			if (location < 0)
+				continue;
+			Entry entry = { name, location, (int)uniformNames.size() };
+			entries.push_back(entry);
+			uniformNames.push_back(name);
+
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				// the bare array name aliases element 0 and shares its shadow slot
+				Entry alias = { name.substr(0, name.size() - 3), location, entry.index };
+				entries.push_back(alias);
+				for (GLint element = 1; element < size; element++)
+				{
+					std::string elementName = alias.name + "[" + std::to_string(element) + "]";
+					Entry next = { elementName, glGetUniformLocation(ID, elementName.c_str()), (int)uniformNames.size() };
+					entries.push_back(next);
+					uniformNames.push_back(elementName);
+				}
+			}
+		}
+
+		// keep the load factor at or below one half so probe chains stay short
+		size_t capacity = 1;
+		while (capacity < entries.size() * 2)
+			capacity <<= 1;
+		uniformTable.resize(capacity);
+		for (size_t i = 0; i < entries.size(); i++)
+			insertUniform(entries[i].name, entries[i].location, entries[i].index);
+		uniformShadows.resize(uniformNames.size());
+	}
+	// utility function for checking shader compilation/linking errors; returns true on success.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(GLuint shader, std::string type)
+	bool checkCompileErrors(GLuint shader, std::string type)
 	{
 		GLint success;
 		GLchar infoLog[1024];
@@ -187,6 +550,7 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success == GL_TRUE;
 	}
 };
 #endif
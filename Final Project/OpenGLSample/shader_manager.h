@@ -0,0 +1,244 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "canonical_path.h"
+#include "gl_state.h"
+#include "shader_permutation.h"
+#include "shader_watcher.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Identifies one program: either three canonical file paths (see canonicalPath), or (for programs built from
+// strings) the sources themselves, plus the permutation's key() mask (NO_PERMUTATION when none is injected)
+// so every permutation of the same files is its own program
+struct ShaderKey
+{
+	bool fromSource;
+	std::string vertex;
+	std::string fragment;
+	std::string geometry;
+	unsigned int permutation;
+
+	bool operator<(const ShaderKey &other) const
+	{
+		if (fromSource != other.fromSource)
+			return fromSource < other.fromSource;
+		if (vertex != other.vertex)
+			return vertex < other.vertex;
+		if (fragment != other.fragment)
+			return fragment < other.fragment;
+		if (geometry != other.geometry)
+			return geometry < other.geometry;
+		return permutation < other.permutation;
+	}
+};
+
+// Owns every program in the application. Requests for an identical (vertex, fragment, geometry) tuple
+// share one compiled Shader; each acquire() must be paired with a release(), and the program is
+// deleted when the last user releases it. Returned references stay valid until then.
+class ShaderManager
+{
+public:
+	// how many acquire() calls reused an existing program and how many had to build one
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	// successful and failed hot reloads
+	unsigned int reloads = 0;
+	unsigned int failedReloads = 0;
+
+	static ShaderManager &get()
+	{
+		static ShaderManager manager;
+		return manager;
+	}
+
+	// program from shader files
+	// ------------------------------------------------------------------------
+	Shader &acquire(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr, ShaderCompileMode mode = COMPILE_BLOCKING)
+	{
+		return acquireFiles(vertexPath, fragmentPath, geometryPath, mode, NO_PERMUTATION, std::string());
+	}
+	// one lighting permutation of a program from shader files; the defines are only generated on a miss
+	// ------------------------------------------------------------------------
+	Shader &acquire(const char *vertexPath, const char *fragmentPath, const LightingPermutation &permutation, ShaderCompileMode mode = COMPILE_BLOCKING)
+	{
+		return acquireFiles(vertexPath, fragmentPath, nullptr, mode, permutation.key(), permutation.defines());
+	}
+	// program from in-memory sources
+	// ------------------------------------------------------------------------
+	Shader &acquireSource(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode = std::string(), ShaderCompileMode mode = COMPILE_BLOCKING)
+	{
+		ShaderKey key = { true, vertexCode, fragmentCode, geometryCode, NO_PERMUTATION };
+		Entry *entry = find(key);
+		if (entry)
+			return shared(*entry, mode);
+		Entry &created = insert(key, new Shader(Shader::fromSource(vertexCode, fragmentCode, geometryCode, mode)));
+		return *created.shader;
+	}
+	// drop one reference; the GL program is deleted with the last one
+	// ------------------------------------------------------------------------
+	void release(GLuint program)
+	{
+		std::map<GLuint, ShaderKey>::iterator byId = keysById.find(program);
+		if (byId == keysById.end())
+			return;
+		std::map<ShaderKey, Entry>::iterator it = programs.find(byId->second);
+		if (--it->second.references > 0)
+			return;
+		GLState::get().forgetProgram(program);
+		glDeleteProgram(program);
+		programs.erase(it);
+		keysById.erase(byId);
+	}
+	void release(const Shader &shader)
+	{
+		release(shader.ID);
+	}
+	// delete every program regardless of outstanding references (application shutdown)
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		for (std::map<ShaderKey, Entry>::iterator it = programs.begin(); it != programs.end(); ++it)
+		{
+			GLState::get().forgetProgram(it->second.shader->ID);
+			glDeleteProgram(it->second.shader->ID);
+		}
+		programs.clear();
+		keysById.clear();
+	}
+	// watch the source files of every file-based program, now and acquired later
+	// ------------------------------------------------------------------------
+	void enableHotReload()
+	{
+		if (watcher)
+			return;
+		watcher.reset(new ShaderWatcher());
+		for (std::map<ShaderKey, Entry>::iterator it = programs.begin(); it != programs.end(); ++it)
+			watchFiles(*it->second.shader);
+	}
+	// rebuild every program whose sources changed on disk; call once per frame, before anything is drawn.
+	// A program that fails to compile keeps its previous ID. Returns how many programs were replaced.
+	// ------------------------------------------------------------------------
+	unsigned int update()
+	{
+		if (!watcher)
+			return 0;
+		std::vector<std::string> changed = watcher->poll();
+		if (changed.empty())
+			return 0;
+		unsigned int replaced = 0;
+		for (std::map<ShaderKey, Entry>::iterator it = programs.begin(); it != programs.end(); ++it)
+		{
+			Shader &shader = *it->second.shader;
+			if (!usesFile(shader, changed))
+				continue;
+			GLuint previous = shader.ID;
+			if (!shader.reload())
+			{
+				std::cout << "Shader reload failed, keeping the previous program: " << shader.vertexPath << " / " << shader.fragmentPath << std::endl;
+				failedReloads++;
+				continue;
+			}
+			keysById.erase(previous);
+			keysById[shader.ID] = it->first;
+			std::cout << "Reloaded shader: " << shader.vertexPath << " / " << shader.fragmentPath << std::endl;
+			reloads++;
+			replaced++;
+		}
+		return replaced;
+	}
+	// number of distinct programs currently alive
+	// ------------------------------------------------------------------------
+	size_t programCount() const
+	{
+		return programs.size();
+	}
+	// ------------------------------------------------------------------------
+	void printStats(std::ostream &out) const
+	{
+		out << "Shader manager: " << programs.size() << " programs, " << hits << " shared / " << (hits + misses) << " requests";
+		if (watcher)
+			out << ", " << reloads << " reloads (" << failedReloads << " failed)";
+		out << std::endl;
+	}
+
+private:
+	struct Entry
+	{
+		std::unique_ptr<Shader> shader;
+		unsigned int references;
+	};
+
+	std::map<ShaderKey, Entry> programs;
+	std::map<GLuint, ShaderKey> keysById;
+	// only created by enableHotReload()
+	std::unique_ptr<ShaderWatcher> watcher;
+
+	ShaderManager() {}
+	ShaderManager(const ShaderManager &) = delete;
+	ShaderManager &operator=(const ShaderManager &) = delete;
+
+	Entry *find(const ShaderKey &key)
+	{
+		std::map<ShaderKey, Entry>::iterator it = programs.find(key);
+		if (it == programs.end())
+			return nullptr;
+		it->second.references++;
+		hits++;
+		return &it->second;
+	}
+
+	Shader &acquireFiles(const char *vertexPath, const char *fragmentPath, const char *geometryPath, ShaderCompileMode mode, unsigned int permutation, const std::string &defines)
+	{
+		ShaderKey key = { false, canonicalPath(vertexPath), canonicalPath(fragmentPath), geometryPath ? canonicalPath(geometryPath) : "", permutation };
+		Entry *entry = find(key);
+		if (entry)
+			return shared(*entry, mode);
+		Entry &created = insert(key, new Shader(vertexPath, fragmentPath, geometryPath, mode, permutation, defines));
+		watchFiles(*created.shader);
+		return *created.shader;
+	}
+
+	// a program shared with an earlier async caller may still be compiling; a blocking caller gets it finished
+	static Shader &shared(Entry &entry, ShaderCompileMode mode)
+	{
+		if (mode == COMPILE_BLOCKING)
+			entry.shader->finish();
+		return *entry.shader;
+	}
+
+	void watchFiles(const Shader &shader)
+	{
+		if (!watcher)
+			return;
+		watcher->watch(shader.vertexPath);
+		watcher->watch(shader.fragmentPath);
+		watcher->watch(shader.geometryPath);
+	}
+
+	static bool usesFile(const Shader &shader, const std::vector<std::string> &files)
+	{
+		for (size_t i = 0; i < files.size(); i++)
+			if (files[i] == shader.vertexPath || files[i] == shader.fragmentPath || (!shader.geometryPath.empty() && files[i] == shader.geometryPath))
+				return true;
+		return false;
+	}
+
+	Entry &insert(const ShaderKey &key, Shader *shader)
+	{
+		misses++;
+		Entry &entry = programs[key];
+		entry.shader.reset(shader);
+		entry.references = 1;
+		keysById[shader->ID] = key;
+		return entry;
+	}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef SHADER_PERMUTATION_H
+#define SHADER_PERMUTATION_H
+
+#include "image_flip.h"
+#include "light_block.h"
+
+#include <string>
+
+// optional parts of the lighting fragment shader; a cleared bit compiles that code out entirely. The
+// texture bits select how the vertex shader reads materials (ImageFlip, TextureArrayPacker), so
+// they are part of the variant too.
+enum LightingFeature : unsigned int {
+	LIGHTING_DIRECTIONAL = 1u << 0,
+	LIGHTING_SPOT = 1u << 1,
+	// textures are uploaded top-down (IMAGE_FLIP_NONE) and the vertex shader flips V
+	LIGHTING_FLIP_TEXCOORDS = 1u << 2,
+	// materials are sampled from TextureArrayPacker arrays
+	LIGHTING_TEXTURE_ARRAYS = 1u << 3
+};
+const unsigned int LIGHTING_ALL_FEATURES = LIGHTING_DIRECTIONAL | LIGHTING_SPOT;
+
+// One specialization of shaderfiles/6.multiple_lights.vs/.fs. Every variant declares the same LightBlock
+// (always NR_POINT_LIGHTS point lights), so a single LightBuffer feeds all of them; a variant only
+// changes which of those lights the fragment shader actually evaluates. ShaderManager and the program
+// binary cache tell variants apart by key() alone, so every define below has to follow from it.
+struct LightingPermutation
+{
+	unsigned int features;
+	unsigned int pointLights;
+
+	// feature bits in the low byte and the point light count above them; constexpr, so a
+	// permutation can be a case label or a compile-time table index
+	constexpr unsigned int key() const
+	{
+		return (features & 0xffu) | (pointLights << 8);
+	}
+
+	// preprocessor block the Shader injects right after the #version line
+	std::string defines() const
+	{
+		unsigned int count = pointLights < NR_POINT_LIGHTS ? pointLights : NR_POINT_LIGHTS;
+		std::string block;
+		block += (features & LIGHTING_DIRECTIONAL) ? "#define DIR_LIGHTS 1\n" : "#define DIR_LIGHTS 0\n";
+		block += (features & LIGHTING_SPOT) ? "#define SPOT_LIGHTS 1\n" : "#define SPOT_LIGHTS 0\n";
+		block += "#define POINT_LIGHTS " + std::to_string(count) + "\n";
+		if (features & LIGHTING_FLIP_TEXCOORDS)
+			block += "#define FLIP_TEXCOORDS 1\n";
+		if (features & LIGHTING_TEXTURE_ARRAYS)
+			block += "#define TEXTURE_ARRAYS 1\n";
+		return block;
+	}
+};
+
+// texture bits matching how the loaders were configured: top-down uploads need the V flip, and
+// packed material arrays need the array path
+inline unsigned int textureFeatures(ImageFlip flip, bool textureArrays)
+{
+	return (flip == IMAGE_FLIP_NONE ? LIGHTING_FLIP_TEXCOORDS : 0u) | (textureArrays ? LIGHTING_TEXTURE_ARRAYS : 0u);
+}
+
+// what the shader evaluates when no permutation is injected
+constexpr LightingPermutation FULL_LIGHTING = { LIGHTING_ALL_FEATURES, NR_POINT_LIGHTS };
+
+static_assert(FULL_LIGHTING.key() != LightingPermutation{ LIGHTING_DIRECTIONAL, NR_POINT_LIGHTS }.key(), "permutation keys must differ");
+#endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+// Reports shader source files that changed on disk. On Linux this is an inotify watch on each file's
+// directory (editors usually save by writing a temp file and renaming it over the original, which a
+// watch on the file itself would lose); elsewhere the modification times are compared on every poll.
+// poll() never blocks, so it can be called once per frame.
+class ShaderWatcher
+{
+public:
+	ShaderWatcher()
+	{
+#ifdef __linux__
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	~ShaderWatcher()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	ShaderWatcher(const ShaderWatcher &) = delete;
+	ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+	// start watching a file; paths are reported back exactly as they were given here
+	void watch(const std::string &path)
+	{
+		if (path.empty())
+			return;
+		size_t slash = path.find_last_of("/\\");
+		std::string directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+		std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+#ifdef __linux__
+		if (fd < 0)
+			return;
+		int wd = -1;
+		for (std::map<int, std::string>::iterator it = directories.begin(); it != directories.end(); ++it)
+			if (it->second == directory)
+				wd = it->first;
+		if (wd < 0)
+		{
+			wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (wd < 0)
+				return;
+			directories[wd] = directory;
+		}
+		files[directory + "/" + name] = path;
+#else
+		files[path] = modificationTime(path);
+#endif
+	}
+
+	// files that changed since the previous poll, each reported once
+	std::vector<std::string> poll()
+	{
+		std::set<std::string> changed;
+#ifdef __linux__
+		if (fd < 0)
+			return std::vector<std::string>();
+		alignas(inotify_event) char buffer[4096];
+		for (;;)
+		{
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			if (length <= 0)
+				break; // EAGAIN: nothing more queued
+			for (char *ptr = buffer; ptr < buffer + length; )
+			{
+				const inotify_event *event = (const inotify_event*)ptr;
+				ptr += sizeof(inotify_event) + event->len;
+				if (event->len == 0)
+					continue;
+				std::map<int, std::string>::iterator directory = directories.find(event->wd);
+				if (directory == directories.end())
+					continue;
+				std::map<std::string, std::string>::iterator file = files.find(directory->second + "/" + event->name);
+				if (file != files.end())
+					changed.insert(file->second);
+			}
+		}
+#else
+		for (std::map<std::string, long long>::iterator it = files.begin(); it != files.end(); ++it)
+		{
+			long long time = modificationTime(it->first);
+			if (time != it->second)
+			{
+				it->second = time;
+				changed.insert(it->first);
+			}
+		}
+#endif
+		return std::vector<std::string>(changed.begin(), changed.end());
+	}
+
+private:
+#ifdef __linux__
+	int fd = -1;
+	// watch descriptor -> directory
+	std::map<int, std::string> directories;
+	// "directory/name" -> path as passed to watch()
+	std::map<std::string, std::string> files;
+#else
+	// path -> last seen modification time
+	std::map<std::string, long long> files;
+
+	static long long modificationTime(const std::string &path)
+	{
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return 0;
+		return (long long)info.st_mtime;
+	}
+#endif
+};
+#endif
\ No newline at end of file
@@ -1,9 +1,18 @@
 #version 330 core
 out vec4 FragColor;
 
+#ifndef TEXTURE_ARRAYS
+#define TEXTURE_ARRAYS 0
+#endif
+
 struct Material {
+#if TEXTURE_ARRAYS
+    sampler2DArray diffuse;
+    sampler2DArray specular;
+#else
     sampler2D diffuse;
     sampler2D specular;
+#endif
     float shininess;
 }; 
 
@@ -44,16 +53,55 @@ struct SpotLight {
 
 #define NR_POINT_LIGHTS 4
 
+// permutation switches, normally injected by the application (see shader_permutation.h);
+// without them every light is evaluated
+#ifndef DIR_LIGHTS
+#define DIR_LIGHTS 1
+#endif
+#ifndef SPOT_LIGHTS
+#define SPOT_LIGHTS 1
+#endif
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS NR_POINT_LIGHTS
+#endif
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+#if TEXTURE_ARRAYS
+flat in vec4 DiffuseRect;
+flat in vec4 SpecularRect;
+flat in vec2 MaterialLayers;
+#endif
+
+// the whole light rig lives in one std140 uniform buffer shared by every lit program
+// (mirrored on the C++ side by LightBlock in light_block.h)
+layout (std140) uniform LightBlock
+{
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
 
 uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
 uniform Material material;
 
+#if TEXTURE_ARRAYS
+// An atlas image (rect smaller than the layer) repeats inside its rect. The gradients come from the
+// unwrapped coordinates, so the jump where fract wraps does not select the smallest mip.
+vec3 sampleRegion(sampler2DArray map, vec4 rect, float layer)
+{
+    vec2 local = mix(TexCoords, fract(TexCoords), lessThan(rect.zw, vec2(1.0)));
+    return vec3(textureGrad(map, vec3(rect.xy + local * rect.zw, layer), dFdx(TexCoords) * rect.zw, dFdy(TexCoords) * rect.zw));
+}
+
+vec3 diffuseColor() { return sampleRegion(material.diffuse, DiffuseRect, MaterialLayers.x); }
+vec3 specularColor() { return sampleRegion(material.specular, SpecularRect, MaterialLayers.y); }
+#else
+vec3 diffuseColor() { return vec3(texture(material.diffuse, TexCoords)); }
+vec3 specularColor() { return vec3(texture(material.specular, TexCoords)); }
+#endif
+
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
@@ -71,13 +119,19 @@ void main()
     // per lamp. In the main() function we take all the calculated colors and sum them up for
     // this fragment's final color.
     // == =====================================================
+    // phases a permutation leaves out are not compiled at all
+    vec3 result = vec3(0.0);
     // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+#if DIR_LIGHTS
+    result += CalcDirLight(dirLight, norm, viewDir);
+#endif
     // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+    for(int i = 0; i < POINT_LIGHTS; i++)
         result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
     // phase 3: spot light
+#if SPOT_LIGHTS
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+#endif
     
     FragColor = vec4(result, 1.0);
 }
@@ -92,9 +146,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor();
+    vec3 diffuse = light.diffuse * diff * diffuseColor();
+    vec3 specular = light.specular * spec * specularColor();
     return (ambient + diffuse + specular);
 }
 
@@ -111,9 +165,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor();
+    vec3 diffuse = light.diffuse * diff * diffuseColor();
+    vec3 specular = light.specular * spec * specularColor();
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -137,9 +191,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor();
+    vec3 diffuse = light.diffuse * diff * diffuseColor();
+    vec3 specular = light.specular * spec * specularColor();
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -2,20 +2,73 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per-instance model matrix (locations 5-8) and normal matrix (9-11), only read when drawing instanced
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in mat3 aInstanceNormalMatrix;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+// set (by LIGHTING_TEXTURE_ARRAYS) when materials come from texture arrays: each mesh or instance passes its
+// layers and UV rects as attributes 12-14 (see material_regions.h)
+#ifndef TEXTURE_ARRAYS
+#define TEXTURE_ARRAYS 0
+#endif
+#if TEXTURE_ARRAYS
+layout (location = 12) in vec4 aDiffuseRect;
+layout (location = 13) in vec4 aSpecularRect;
+layout (location = 14) in vec2 aMaterialLayers;
+
+flat out vec4 DiffuseRect;
+flat out vec4 SpecularRect;
+flat out vec2 MaterialLayers;
+#endif
+
 uniform mat4 model;
+// transpose(inverse(mat3(model))), computed once per object on the CPU
+uniform mat3 normalMatrix;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool instanced;
+
+// set (by VertexFormat::defines) for meshes whose normals are octahedral-encoded in aNormal.xy
+#ifndef PACKED_NORMALS
+#define PACKED_NORMALS 0
+#endif
+// set (by LIGHTING_FLIP_TEXCOORDS) when textures are uploaded top-down instead of being flipped on the CPU
+#ifndef FLIP_TEXCOORDS
+#define FLIP_TEXCOORDS 0
+#endif
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+#if PACKED_NORMALS
+    vec3 normal = octDecode(aNormal.xy);
+#else
+    vec3 normal = aNormal;
+#endif
+    mat4 world = instanced ? aInstanceModel : model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal = (instanced ? aInstanceNormalMatrix : normalMatrix) * normal;
+#if FLIP_TEXCOORDS
+    TexCoords = vec2(aTexCoords.x, 1.0 - aTexCoords.y);
+#else
     TexCoords = aTexCoords;
+#endif
+#if TEXTURE_ARRAYS
+    DiffuseRect = aDiffuseRect;
+    SpecularRect = aSpecularRect;
+    MaterialLayers = aMaterialLayers;
+#endif
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceModel;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform bool instanced;
+
+// stand-in used while the real programs are still compiling
+void main()
+{
+    mat4 world = instanced ? aInstanceModel : model;
+    gl_Position = projection * view * world * vec4(aPos, 1.0);
+}
\ No newline at end of file
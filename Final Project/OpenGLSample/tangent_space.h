@@ -0,0 +1,450 @@
+#ifndef TANGENT_SPACE_H
+#define TANGENT_SPACE_H
+
+#include <glm/glm.hpp>
+
+#include "cpu_features.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef CPU_FEATURES_X86
+#define TANGENT_SPACE_SIMD
+#define TANGENT_SPACE_AVX2_TARGET CPU_AVX2_TARGET
+#endif
+
+// area-weighted smooth normals for meshes that come without any
+inline void generateNormals(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+	for (size_t v = 0; v < vertices.size(); v++)
+		vertices[v].Normal = glm::vec3(0.0f);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		Vertex &a = vertices[indices[i]];
+		Vertex &b = vertices[indices[i + 1]];
+		Vertex &c = vertices[indices[i + 2]];
+		// the cross product's length is twice the triangle area, which is the weight we want
+		glm::vec3 faceNormal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+		a.Normal += faceNormal;
+		b.Normal += faceNormal;
+		c.Normal += faceNormal;
+	}
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		float length = glm::length(vertices[v].Normal);
+		vertices[v].Normal = length > 0.0f ? vertices[v].Normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+}
+
+// any unit vector perpendicular to n, for vertices whose UVs give no usable direction
+inline glm::vec3 perpendicular(const glm::vec3 &n)
+{
+	glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(glm::cross(n, axis));
+}
+
+// Gram-Schmidt: make the accumulated tangent orthonormal to the normal and derive the bitangent
+// with the handedness the accumulated bitangent implies
+inline void orthonormalizeTangent(Vertex &vertex, const glm::vec3 &tangent, const glm::vec3 &bitangent)
+{
+	const glm::vec3 &n = vertex.Normal;
+	glm::vec3 t = tangent - n * glm::dot(n, tangent);
+	float length = glm::length(t);
+	t = length > 1e-8f ? t / length : perpendicular(n);
+	float handedness = glm::dot(glm::cross(n, t), bitangent) < 0.0f ? -1.0f : 1.0f;
+	vertex.Tangent = t;
+	vertex.Bitangent = glm::cross(n, t) * handedness;
+}
+
+// UV-space tangent and bitangent of one triangle (Lengyel's method); false when its UVs are degenerate
+inline bool triangleTangent(const Vertex &a, const Vertex &b, const Vertex &c, glm::vec3 &tangent, glm::vec3 &bitangent)
+{
+	glm::vec3 e1 = b.Position - a.Position;
+	glm::vec3 e2 = c.Position - a.Position;
+	float du1 = b.TexCoords.x - a.TexCoords.x, dv1 = b.TexCoords.y - a.TexCoords.y;
+	float du2 = c.TexCoords.x - a.TexCoords.x, dv2 = c.TexCoords.y - a.TexCoords.y;
+	float determinant = du1 * dv2 - du2 * dv1;
+	if (std::fabs(determinant) < 1e-12f)
+		return false;
+	float r = 1.0f / determinant;
+	tangent = (e1 * dv2 - e2 * dv1) * r;
+	bitangent = (e2 * du1 - e1 * du2) * r;
+	return true;
+}
+
+// Per-vertex tangent frames from UV gradients: every triangle adds its tangent and bitangent to its
+// three corners, then each vertex is orthonormalized against its normal. Needs normals; the reference
+// implementation the SIMD paths below are checked against.
+inline void generateTangentsScalar(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+	std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+	std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		unsigned int i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+		glm::vec3 t, b;
+		if (!triangleTangent(vertices[i0], vertices[i1], vertices[i2], t, b))
+			continue;
+		tangents[i0] += t; tangents[i1] += t; tangents[i2] += t;
+		bitangents[i0] += b; bitangents[i1] += b; bitangents[i2] += b;
+	}
+	for (size_t v = 0; v < vertices.size(); v++)
+		orthonormalizeTangent(vertices[v], tangents[v], bitangents[v]);
+}
+
+enum TangentPath {
+	TANGENTS_SCALAR,
+	TANGENTS_SSE,
+	TANGENTS_AVX2
+};
+
+// SIMD paths: 4 (SSE) or 8 (AVX2) triangles, then vertices, per step. The corners are loaded straight
+// from the Vertex array and transposed in registers into structure-of-arrays form (x of every lane in
+// one register, y in the next...), the math runs on whole registers, and the results are transposed
+// back so each triangle adds to its corners' sums with one 4-wide add for the tangent and one for the
+// bitangent. The sums are interleaved per vertex (tangent xyz, pad, bitangent xyz, pad) and filled in
+// triangle order, so every operation matches generateTangentsScalar and the frames come out identical.
+#ifdef TANGENT_SPACE_SIMD
+// leftover triangles and vertices of the SIMD loops
+inline void accumulateTriangleTangent(const std::vector<Vertex> &vertices, const unsigned int *corners, float *sums)
+{
+	glm::vec3 t, b;
+	if (!triangleTangent(vertices[corners[0]], vertices[corners[1]], vertices[corners[2]], t, b))
+		return;
+	for (int c = 0; c < 3; c++)
+	{
+		float *sum = sums + (size_t)corners[c] * 8;
+		sum[0] += t.x; sum[1] += t.y; sum[2] += t.z;
+		sum[4] += b.x; sum[5] += b.y; sum[6] += b.z;
+	}
+}
+
+inline void finishTangentFrame(Vertex &vertex, const float *sum)
+{
+	orthonormalizeTangent(vertex, glm::vec3(sum[0], sum[1], sum[2]), glm::vec3(sum[4], sum[5], sum[6]));
+}
+
+// ------------------------------------------------------------------------
+inline void generateTangentsSse(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+	std::vector<float> sums(vertices.size() * 8, 0.0f);
+	const __m128 epsilon = _mm_set1_ps(1e-12f);
+	const __m128 minLength = _mm_set1_ps(1e-8f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	size_t triangleCount = indices.size() / 3;
+	size_t triangle = 0;
+	for (; triangle + 4 <= triangleCount; triangle += 4)
+	{
+		const unsigned int *corners = &indices[triangle * 3];
+		__m128 px[3], py[3], pz[3], u[3], v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			// Position plus Normal.x, then TexCoords, of the four triangles' corner c
+			const Vertex &v0 = vertices[corners[c]], &v1 = vertices[corners[3 + c]], &v2 = vertices[corners[6 + c]], &v3 = vertices[corners[9 + c]];
+			__m128 r0 = _mm_loadu_ps(&v0.Position.x), r1 = _mm_loadu_ps(&v1.Position.x), r2 = _mm_loadu_ps(&v2.Position.x), r3 = _mm_loadu_ps(&v3.Position.x);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			px[c] = r0; py[c] = r1; pz[c] = r2;
+			__m128 uv01 = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64*)&v0.TexCoords.x), (const __m64*)&v1.TexCoords.x);
+			__m128 uv23 = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64*)&v2.TexCoords.x), (const __m64*)&v3.TexCoords.x);
+			u[c] = _mm_shuffle_ps(uv01, uv23, _MM_SHUFFLE(2, 0, 2, 0));
+			v[c] = _mm_shuffle_ps(uv01, uv23, _MM_SHUFFLE(3, 1, 3, 1));
+		}
+		__m128 e1x = _mm_sub_ps(px[1], px[0]), e1y = _mm_sub_ps(py[1], py[0]), e1z = _mm_sub_ps(pz[1], pz[0]);
+		__m128 e2x = _mm_sub_ps(px[2], px[0]), e2y = _mm_sub_ps(py[2], py[0]), e2z = _mm_sub_ps(pz[2], pz[0]);
+		__m128 du1 = _mm_sub_ps(u[1], u[0]), dv1 = _mm_sub_ps(v[1], v[0]);
+		__m128 du2 = _mm_sub_ps(u[2], u[0]), dv2 = _mm_sub_ps(v[2], v[0]);
+		__m128 determinant = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(du2, dv1));
+		// degenerate UVs add zero, which leaves the sums exactly as the scalar `continue` does
+		__m128 valid = _mm_cmpnlt_ps(_mm_andnot_ps(signBit, determinant), epsilon);
+		__m128 r = _mm_and_ps(valid, _mm_div_ps(one, determinant));
+		__m128 tx = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1x, dv2), _mm_mul_ps(e2x, dv1)), r));
+		__m128 ty = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1y, dv2), _mm_mul_ps(e2y, dv1)), r));
+		__m128 tz = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1z, dv2), _mm_mul_ps(e2z, dv1)), r));
+		__m128 bx = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2x, du1), _mm_mul_ps(e1x, du2)), r));
+		__m128 by = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2y, du1), _mm_mul_ps(e1y, du2)), r));
+		__m128 bz = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2z, du1), _mm_mul_ps(e1z, du2)), r));
+
+		__m128 tw = zero, bw = zero;
+		_MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+		__m128 tangents[4] = { tx, ty, tz, tw };
+		__m128 bitangents[4] = { bx, by, bz, bw };
+		for (int k = 0; k < 4; k++)
+			for (int c = 0; c < 3; c++)
+			{
+				float *sum = &sums[(size_t)corners[k * 3 + c] * 8];
+				_mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), tangents[k]));
+				_mm_storeu_ps(sum + 4, _mm_add_ps(_mm_loadu_ps(sum + 4), bitangents[k]));
+			}
+	}
+	for (; triangle < triangleCount; triangle++)
+		accumulateTriangleTangent(vertices, &indices[triangle * 3], sums.data());
+
+	size_t vertex = 0;
+	for (; vertex + 4 <= vertices.size(); vertex += 4)
+	{
+		Vertex *group = &vertices[vertex];
+		const float *sum = &sums[vertex * 8];
+		// Normal plus TexCoords.x
+		__m128 nx = _mm_loadu_ps(&group[0].Normal.x), ny = _mm_loadu_ps(&group[1].Normal.x), nz = _mm_loadu_ps(&group[2].Normal.x), nw = _mm_loadu_ps(&group[3].Normal.x);
+		_MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+		__m128 tx = _mm_loadu_ps(sum), ty = _mm_loadu_ps(sum + 8), tz = _mm_loadu_ps(sum + 16), tw = _mm_loadu_ps(sum + 24);
+		_MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+		__m128 bx = _mm_loadu_ps(sum + 4), by = _mm_loadu_ps(sum + 12), bz = _mm_loadu_ps(sum + 20), bw = _mm_loadu_ps(sum + 28);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+		// Gram-Schmidt: t -= n * dot(n, t), then normalize
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, tx), _mm_mul_ps(ny, ty)), _mm_mul_ps(nz, tz));
+		tx = _mm_sub_ps(tx, _mm_mul_ps(nx, d));
+		ty = _mm_sub_ps(ty, _mm_mul_ps(ny, d));
+		tz = _mm_sub_ps(tz, _mm_mul_ps(nz, d));
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+		int degenerate = _mm_movemask_ps(_mm_cmpngt_ps(length, minLength));
+		tx = _mm_div_ps(tx, length);
+		ty = _mm_div_ps(ty, length);
+		tz = _mm_div_ps(tz, length);
+
+		// bitangent = cross(n, t), flipped when the summed bitangent points the other way
+		__m128 cx = _mm_sub_ps(_mm_mul_ps(ny, tz), _mm_mul_ps(nz, ty));
+		__m128 cy = _mm_sub_ps(_mm_mul_ps(nz, tx), _mm_mul_ps(nx, tz));
+		__m128 cz = _mm_sub_ps(_mm_mul_ps(nx, ty), _mm_mul_ps(ny, tx));
+		__m128 handedness = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, bx), _mm_mul_ps(cy, by)), _mm_mul_ps(cz, bz));
+		__m128 flip = _mm_and_ps(_mm_cmplt_ps(handedness, zero), signBit);
+		cx = _mm_xor_ps(cx, flip);
+		cy = _mm_xor_ps(cy, flip);
+		cz = _mm_xor_ps(cz, flip);
+
+		// Tangent and Bitangent are adjacent: write (t.xyz, b.x) with one store and (b.yz) with a second
+		__m128 ow = cx;
+		_MM_TRANSPOSE4_PS(tx, ty, tz, ow);
+		__m128 frames[4] = { tx, ty, tz, ow };
+		__m128 yz01 = _mm_unpacklo_ps(cy, cz), yz23 = _mm_unpackhi_ps(cy, cz);
+		for (int k = 0; k < 4; k++)
+			_mm_storeu_ps(&group[k].Tangent.x, frames[k]);
+		_mm_storel_pi((__m64*)&group[0].Bitangent.y, yz01);
+		_mm_storeh_pi((__m64*)&group[1].Bitangent.y, yz01);
+		_mm_storel_pi((__m64*)&group[2].Bitangent.y, yz23);
+		_mm_storeh_pi((__m64*)&group[3].Bitangent.y, yz23);
+		for (int k = 0; k < 4; k++)
+			if (degenerate & (1 << k))
+				finishTangentFrame(group[k], sum + k * 8);
+	}
+	for (; vertex < vertices.size(); vertex++)
+		finishTangentFrame(vertices[vertex], &sums[vertex * 8]);
+}
+
+// ------------------------------------------------------------------------
+// 4x4 transpose inside each 128-bit half: lane k of the low half is row k of elements 0-3, of the
+// high half row k of elements 4-7
+TANGENT_SPACE_AVX2_TARGET inline void transposeHalves(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3)
+{
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+	__m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+	r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+TANGENT_SPACE_AVX2_TARGET inline __m256 loadPair(const float *low, const float *high)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
+
+// ------------------------------------------------------------------------
+// the SSE path 8 lanes wide; only called when the CPU reports AVX2 (see bestTangentPath)
+TANGENT_SPACE_AVX2_TARGET inline void generateTangentsAvx2(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+	std::vector<float> sums(vertices.size() * 8, 0.0f);
+	const __m256 epsilon = _mm256_set1_ps(1e-12f);
+	const __m256 minLength = _mm256_set1_ps(1e-8f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	size_t triangleCount = indices.size() / 3;
+	size_t triangle = 0;
+	for (; triangle + 8 <= triangleCount; triangle += 8)
+	{
+		const unsigned int *corners = &indices[triangle * 3];
+		__m256 px[3], py[3], pz[3], u[3], v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			// triangle k sits in lane k % 4 of half k / 4
+			const Vertex *corner[8];
+			for (int k = 0; k < 8; k++)
+				corner[k] = &vertices[corners[k * 3 + c]];
+			__m256 r0 = loadPair(&corner[0]->Position.x, &corner[4]->Position.x);
+			__m256 r1 = loadPair(&corner[1]->Position.x, &corner[5]->Position.x);
+			__m256 r2 = loadPair(&corner[2]->Position.x, &corner[6]->Position.x);
+			__m256 r3 = loadPair(&corner[3]->Position.x, &corner[7]->Position.x);
+			transposeHalves(r0, r1, r2, r3);
+			px[c] = r0; py[c] = r1; pz[c] = r2;
+			__m128 uv01 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&corner[0]->TexCoords.x), (const __m64*)&corner[1]->TexCoords.x);
+			__m128 uv23 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&corner[2]->TexCoords.x), (const __m64*)&corner[3]->TexCoords.x);
+			__m128 uv45 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&corner[4]->TexCoords.x), (const __m64*)&corner[5]->TexCoords.x);
+			__m128 uv67 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&corner[6]->TexCoords.x), (const __m64*)&corner[7]->TexCoords.x);
+			__m256 uvLow = _mm256_insertf128_ps(_mm256_castps128_ps256(uv01), uv45, 1);
+			__m256 uvHigh = _mm256_insertf128_ps(_mm256_castps128_ps256(uv23), uv67, 1);
+			u[c] = _mm256_shuffle_ps(uvLow, uvHigh, _MM_SHUFFLE(2, 0, 2, 0));
+			v[c] = _mm256_shuffle_ps(uvLow, uvHigh, _MM_SHUFFLE(3, 1, 3, 1));
+		}
+		__m256 e1x = _mm256_sub_ps(px[1], px[0]), e1y = _mm256_sub_ps(py[1], py[0]), e1z = _mm256_sub_ps(pz[1], pz[0]);
+		__m256 e2x = _mm256_sub_ps(px[2], px[0]), e2y = _mm256_sub_ps(py[2], py[0]), e2z = _mm256_sub_ps(pz[2], pz[0]);
+		__m256 du1 = _mm256_sub_ps(u[1], u[0]), dv1 = _mm256_sub_ps(v[1], v[0]);
+		__m256 du2 = _mm256_sub_ps(u[2], u[0]), dv2 = _mm256_sub_ps(v[2], v[0]);
+		__m256 determinant = _mm256_sub_ps(_mm256_mul_ps(du1, dv2), _mm256_mul_ps(du2, dv1));
+		__m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(signBit, determinant), epsilon, _CMP_NLT_UQ);
+		__m256 r = _mm256_and_ps(valid, _mm256_div_ps(one, determinant));
+		__m256 tx = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e1x, dv2), _mm256_mul_ps(e2x, dv1)), r));
+		__m256 ty = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e1y, dv2), _mm256_mul_ps(e2y, dv1)), r));
+		__m256 tz = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e1z, dv2), _mm256_mul_ps(e2z, dv1)), r));
+		__m256 bx = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e2x, du1), _mm256_mul_ps(e1x, du2)), r));
+		__m256 by = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e2y, du1), _mm256_mul_ps(e1y, du2)), r));
+		__m256 bz = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(e2z, du1), _mm256_mul_ps(e1z, du2)), r));
+
+		__m256 tw = zero, bw = zero;
+		transposeHalves(tx, ty, tz, tw);
+		transposeHalves(bx, by, bz, bw);
+		__m256 tangents[4] = { tx, ty, tz, tw };
+		__m256 bitangents[4] = { bx, by, bz, bw };
+		// triangles in order: 0-3 from the low halves, 4-7 from the high halves
+		for (int k = 0; k < 8; k++)
+		{
+			__m128 t = k < 4 ? _mm256_castps256_ps128(tangents[k]) : _mm256_extractf128_ps(tangents[k - 4], 1);
+			__m128 b = k < 4 ? _mm256_castps256_ps128(bitangents[k]) : _mm256_extractf128_ps(bitangents[k - 4], 1);
+			for (int c = 0; c < 3; c++)
+			{
+				float *sum = &sums[(size_t)corners[k * 3 + c] * 8];
+				_mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), t));
+				_mm_storeu_ps(sum + 4, _mm_add_ps(_mm_loadu_ps(sum + 4), b));
+			}
+		}
+	}
+	for (; triangle < triangleCount; triangle++)
+		accumulateTriangleTangent(vertices, &indices[triangle * 3], sums.data());
+
+	size_t vertex = 0;
+	for (; vertex + 8 <= vertices.size(); vertex += 8)
+	{
+		Vertex *group = &vertices[vertex];
+		const float *sum = &sums[vertex * 8];
+		__m256 nx = loadPair(&group[0].Normal.x, &group[4].Normal.x), ny = loadPair(&group[1].Normal.x, &group[5].Normal.x);
+		__m256 nz = loadPair(&group[2].Normal.x, &group[6].Normal.x), nw = loadPair(&group[3].Normal.x, &group[7].Normal.x);
+		transposeHalves(nx, ny, nz, nw);
+		// each vertex's sums are 8 floats: tangent in the low half of the row, bitangent in the high half
+		__m256 s0 = _mm256_loadu_ps(sum), s1 = _mm256_loadu_ps(sum + 8), s2 = _mm256_loadu_ps(sum + 16), s3 = _mm256_loadu_ps(sum + 24);
+		__m256 s4 = _mm256_loadu_ps(sum + 32), s5 = _mm256_loadu_ps(sum + 40), s6 = _mm256_loadu_ps(sum + 48), s7 = _mm256_loadu_ps(sum + 56);
+		__m256 tx = _mm256_permute2f128_ps(s0, s4, 0x20), ty = _mm256_permute2f128_ps(s1, s5, 0x20);
+		__m256 tz = _mm256_permute2f128_ps(s2, s6, 0x20), tw = _mm256_permute2f128_ps(s3, s7, 0x20);
+		__m256 bx = _mm256_permute2f128_ps(s0, s4, 0x31), by = _mm256_permute2f128_ps(s1, s5, 0x31);
+		__m256 bz = _mm256_permute2f128_ps(s2, s6, 0x31), bw = _mm256_permute2f128_ps(s3, s7, 0x31);
+		transposeHalves(tx, ty, tz, tw);
+		transposeHalves(bx, by, bz, bw);
+
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, tx), _mm256_mul_ps(ny, ty)), _mm256_mul_ps(nz, tz));
+		tx = _mm256_sub_ps(tx, _mm256_mul_ps(nx, d));
+		ty = _mm256_sub_ps(ty, _mm256_mul_ps(ny, d));
+		tz = _mm256_sub_ps(tz, _mm256_mul_ps(nz, d));
+		__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+		int degenerate = _mm256_movemask_ps(_mm256_cmp_ps(length, minLength, _CMP_NGT_UQ));
+		tx = _mm256_div_ps(tx, length);
+		ty = _mm256_div_ps(ty, length);
+		tz = _mm256_div_ps(tz, length);
+
+		__m256 cx = _mm256_sub_ps(_mm256_mul_ps(ny, tz), _mm256_mul_ps(nz, ty));
+		__m256 cy = _mm256_sub_ps(_mm256_mul_ps(nz, tx), _mm256_mul_ps(nx, tz));
+		__m256 cz = _mm256_sub_ps(_mm256_mul_ps(nx, ty), _mm256_mul_ps(ny, tx));
+		__m256 handedness = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, bx), _mm256_mul_ps(cy, by)), _mm256_mul_ps(cz, bz));
+		__m256 flip = _mm256_and_ps(_mm256_cmp_ps(handedness, zero, _CMP_LT_OQ), signBit);
+		cx = _mm256_xor_ps(cx, flip);
+		cy = _mm256_xor_ps(cy, flip);
+		cz = _mm256_xor_ps(cz, flip);
+
+		__m256 ow = cx;
+		transposeHalves(tx, ty, tz, ow);
+		__m256 frames[4] = { tx, ty, tz, ow };
+		__m256 yzLow = _mm256_unpacklo_ps(cy, cz), yzHigh = _mm256_unpackhi_ps(cy, cz);
+		for (int k = 0; k < 4; k++)
+		{
+			_mm_storeu_ps(&group[k].Tangent.x, _mm256_castps256_ps128(frames[k]));
+			_mm_storeu_ps(&group[k + 4].Tangent.x, _mm256_extractf128_ps(frames[k], 1));
+		}
+		__m128 yz01 = _mm256_castps256_ps128(yzLow), yz45 = _mm256_extractf128_ps(yzLow, 1);
+		__m128 yz23 = _mm256_castps256_ps128(yzHigh), yz67 = _mm256_extractf128_ps(yzHigh, 1);
+		_mm_storel_pi((__m64*)&group[0].Bitangent.y, yz01);
+		_mm_storeh_pi((__m64*)&group[1].Bitangent.y, yz01);
+		_mm_storel_pi((__m64*)&group[2].Bitangent.y, yz23);
+		_mm_storeh_pi((__m64*)&group[3].Bitangent.y, yz23);
+		_mm_storel_pi((__m64*)&group[4].Bitangent.y, yz45);
+		_mm_storeh_pi((__m64*)&group[5].Bitangent.y, yz45);
+		_mm_storel_pi((__m64*)&group[6].Bitangent.y, yz67);
+		_mm_storeh_pi((__m64*)&group[7].Bitangent.y, yz67);
+		// lane k of a half is vertex k of that half
+		for (int k = 0; k < 8; k++)
+			if (degenerate & (1 << k))
+				finishTangentFrame(group[k], sum + k * 8);
+	}
+	_mm256_zeroupper();
+	for (; vertex < vertices.size(); vertex++)
+		finishTangentFrame(vertices[vertex], &sums[vertex * 8]);
+}
+#endif
+
+// ------------------------------------------------------------------------
+// widest path this CPU runs, checked once
+inline TangentPath bestTangentPath()
+{
+#ifdef TANGENT_SPACE_SIMD
+	static const TangentPath best = cpuHasAvx2() ? TANGENTS_AVX2 : TANGENTS_SSE;
+	return best;
+#else
+	return TANGENTS_SCALAR;
+#endif
+}
+
+// Tangent frames through the given path; paths this build or CPU lacks fall back to a narrower one.
+inline void generateTangents(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, TangentPath path)
+{
+#ifdef TANGENT_SPACE_SIMD
+	if (path == TANGENTS_AVX2 && bestTangentPath() == TANGENTS_AVX2)
+		generateTangentsAvx2(vertices, indices);
+	else if (path != TANGENTS_SCALAR)
+		generateTangentsSse(vertices, indices);
+	else
+		generateTangentsScalar(vertices, indices);
+#else
+	(void)path;
+	generateTangentsScalar(vertices, indices);
+#endif
+}
+
+inline void generateTangents(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+	generateTangents(vertices, indices, bestTangentPath());
+}
+
+// ------------------------------------------------------------------------
+// Runs `path` and the scalar reference on copies of the mesh and returns the largest difference in any
+// tangent or bitangent component; 0 means the two paths agree exactly.
+inline float tangentPathError(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, TangentPath path)
+{
+	std::vector<Vertex> reference = vertices;
+	std::vector<Vertex> candidate = vertices;
+	generateTangentsScalar(reference, indices);
+	generateTangents(candidate, indices, path);
+	float error = 0.0f;
+	for (size_t v = 0; v < vertices.size(); v++)
+		for (int c = 0; c < 3; c++)
+		{
+			error = std::max(error, std::fabs(reference[v].Tangent[c] - candidate[v].Tangent[c]));
+			error = std::max(error, std::fabs(reference[v].Bitangent[c] - candidate[v].Bitangent[c]));
+		}
+	return error;
+}
+#endif
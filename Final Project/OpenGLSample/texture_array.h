@@ -0,0 +1,431 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "baked_texture.h"
+#include "gl_state.h"
+#include "image_flip.h"
+#include "material_regions.h"
+#include "mip_generator.h"
+#include "stb_image.h"
+#include "texture_loader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct TextureArrayStats
+{
+	unsigned int images = 0;
+	// images whose levels came straight from their baked file
+	unsigned int baked = 0;
+	unsigned int failed = 0;
+	// GL_TEXTURE_2D_ARRAY objects and their layers; atlas pages are layers as well
+	unsigned int arrays = 0;
+	unsigned int layers = 0;
+	unsigned int atlasPages = 0;
+	unsigned int atlasImages = 0;
+	unsigned long long bytes = 0;
+};
+
+// Packs a material set into a few texture arrays, so that meshes with different images no longer need
+// different bindings. Images with the same size and TextureOptions become layers of one
+// GL_TEXTURE_2D_ARRAY. Images no larger than atlasMaxImage are shelf-packed onto atlas pages, which are
+// layers of arrays of their own. Each image comes back as a TextureRegion for the lighting shader's
+// TEXTURE_ARRAYS path (see material_regions.h).
+// A layer whose up-to-date <image>.gstx (see baked_texture.h) is in the array's format is uploaded from the
+// mapped file, like TextureLoader does with TextureLoader::bakedTextures on; atlas images are always
+// decoded, since their pages are filtered and encoded as a whole.
+// Atlas images always repeat, because the shader wraps their coordinates itself. Their mips use the box
+// filter, and only the levels the gutter keeps free of neighbours are kept. build() decodes on
+// ThreadPool::shared() and uploads synchronously, so call it from loading code outside the pool.
+class TextureArrayPacker
+{
+public:
+	TextureArrayStats stats;
+	int atlasMaxImage = 256;
+	int atlasSize = 1024;
+	// border of wrapped (GL_REPEAT) or clamped texels around each atlas image; a power of two of at least
+	// 4, and mips up to log2(atlasGutter) (log2(atlasGutter / 4) on compressed pages) never mix neighbouring
+	// images
+	int atlasGutter = 8;
+
+	// returns the image's index for region(); the regions are filled in by build()
+	size_t add(const char *path, const TextureOptions &options = TextureOptions())
+	{
+		Image image;
+		image.path = path;
+		image.options = options;
+		// the workers only see the options, so the driver check happens here
+		image.options.compression = supportedCompression(options.compression, options.srgb);
+		images.push_back(image);
+		return images.size() - 1;
+	}
+
+	const TextureRegion &region(size_t image) const
+	{
+		return images[image].region;
+	}
+
+	// false if an image could not be loaded; it keeps an empty region and the others are packed anyway
+	// ------------------------------------------------------------------------
+	bool build()
+	{
+		bool tryBaked = TextureLoader::get().bakedTextures;
+		ThreadPool::shared().parallelFor(images.size(), [this, tryBaked](size_t i) { decode(images[i], tryBaked); });
+
+		std::map<LayerKey, std::vector<size_t> > layerGroups;
+		std::map<TextureOptions, std::vector<size_t> > atlasGroups;
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			const Image &image = images[i];
+			if (!loaded(image))
+				continue;
+			if (fitsAtlas(image.width, image.height))
+				atlasGroups[image.options].push_back(i);
+			else
+				layerGroups[layerKey(image)].push_back(i);
+		}
+
+		// a baked file that is not in its array's format (a wider image in the group changed it) is decoded
+		// after all
+		std::vector<std::pair<size_t, LayerKey> > redecode;
+		for (std::map<LayerKey, std::vector<size_t> >::iterator it = layerGroups.begin(); it != layerGroups.end(); ++it)
+		{
+			GLenum format = groupInternalFormat(it->second);
+			for (size_t i = 0; i < it->second.size(); i++)
+			{
+				Image &image = images[it->second[i]];
+				if (image.baked && image.baked->internalFormat != format)
+				{
+					image.baked.reset();
+					redecode.push_back(std::make_pair(it->second[i], it->first));
+				}
+			}
+		}
+		ThreadPool::shared().parallelFor(redecode.size(), [this, &redecode](size_t i) { decode(images[redecode[i].first], false); });
+		for (size_t i = 0; i < redecode.size(); i++)
+		{
+			if (loaded(images[redecode[i].first]))
+				continue;
+			std::map<LayerKey, std::vector<size_t> >::iterator group = layerGroups.find(redecode[i].second);
+			group->second.erase(std::find(group->second.begin(), group->second.end(), redecode[i].first));
+			if (group->second.empty())
+				layerGroups.erase(group);
+		}
+
+		for (size_t i = 0; i < images.size(); i++)
+			if (images[i].pixels != nullptr || images[i].baked)
+				stats.images++;
+		for (std::map<LayerKey, std::vector<size_t> >::iterator it = layerGroups.begin(); it != layerGroups.end(); ++it)
+			buildLayers(it->second);
+		for (std::map<TextureOptions, std::vector<size_t> >::iterator it = atlasGroups.begin(); it != atlasGroups.end(); ++it)
+			buildAtlas(it->second);
+
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			stbi_image_free(images[i].pixels);
+			images[i].pixels = nullptr;
+			images[i].baked.reset();
+		}
+		return stats.failed == 0;
+	}
+
+	// deletes the arrays; call before the context goes away
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			GLState::get().forgetTexture(textures[i]);
+			glDeleteTextures(1, &textures[i]);
+		}
+		textures.clear();
+		images.clear();
+	}
+
+	void printStats(std::ostream &out) const
+	{
+		out << "Texture arrays: " << stats.images << " images (" << stats.baked << " baked, " << stats.failed << " failed) in " << stats.arrays << " arrays of "
+			<< stats.layers << " layers, " << stats.atlasImages << " of them on " << stats.atlasPages << " atlas pages, "
+			<< stats.bytes / (1024 * 1024) << " MB" << std::endl;
+	}
+
+private:
+	struct Image
+	{
+		std::string path;
+		TextureOptions options;
+		unsigned char *pixels = nullptr;
+		// or instead of pixels, the mapped levels of an array layer
+		std::shared_ptr<BakedTextureFile> baked;
+		const char *error = nullptr;
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		TextureRegion region;
+	};
+
+	typedef std::pair<std::pair<int, int>, TextureOptions> LayerKey;
+
+	// one layer's levels for uploadArray: a CompressedImage's or a BakedTextureFile's, with offsets from data
+	struct LayerLevels
+	{
+		const unsigned char *data;
+		const std::vector<CompressedLevel> *levels;
+	};
+
+	std::vector<Image> images;
+	std::vector<GLuint> textures;
+
+	// Runs on a worker, like TextureLoader's decode. Only images too large for the atlas keep their baked
+	// file, since atlas pages need the pixels.
+	// ------------------------------------------------------------------------
+	void decode(Image &image, bool tryBaked) const
+	{
+		const TextureOptions &options = image.options;
+		if (tryBaked)
+			image.baked = openBakedTexture(image.path, options.flip, options.compression, options.srgb, options.mipFilter);
+		if (image.baked)
+		{
+			image.width = (int)image.baked->header->width;
+			image.height = (int)image.baked->header->height;
+			image.channels = (int)image.baked->header->channels;
+			if (!fitsAtlas(image.width, image.height))
+				return;
+			image.baked.reset();
+		}
+		stbi_set_flip_vertically_on_load_thread(image.options.flip == IMAGE_FLIP_IN_DECODER);
+		image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &image.channels, 0);
+		if (image.pixels == nullptr)
+			image.error = imageLoadFailure(image.path);
+		else if (image.options.flip == IMAGE_FLIP_ROWS)
+			flipImageVertically(image.pixels, image.width, image.height, image.channels);
+	}
+
+	bool fitsAtlas(int width, int height) const
+	{
+		int largest = std::max(width, height);
+		return largest <= atlasMaxImage && align(largest + 2 * atlasGutter) <= atlasSize;
+	}
+
+	static LayerKey layerKey(const Image &image)
+	{
+		return LayerKey(std::make_pair(image.width, image.height), image.options);
+	}
+
+	// counts and reports an image that could not be read
+	bool loaded(const Image &image)
+	{
+		if (image.pixels != nullptr || image.baked)
+			return true;
+		std::cout << "ERROR::TEXTURE_ARRAY::LOAD_FAILED: " << image.path << " (" << image.error << ")" << std::endl;
+		stats.failed++;
+		return false;
+	}
+
+	// An array has one internal format, so the widest channel count in the group decides what
+	// TEXTURE_BC_AUTO becomes and whether the data is stored as sRGB. Every image is baked from RGBA8.
+	// ------------------------------------------------------------------------
+	void groupFormat(const std::vector<size_t> &group, TextureCompression &compression, bool &srgb) const
+	{
+		int channels = 0;
+		for (size_t i = 0; i < group.size(); i++)
+			channels = std::max(channels, images[group[i]].channels);
+		const TextureOptions &options = images[group[0]].options;
+		compression = resolveCompression(options.compression, channels);
+		srgb = options.srgb && channels >= 3;
+	}
+
+	// the format bakeImage gives the group's layers
+	GLenum groupInternalFormat(const std::vector<size_t> &group) const
+	{
+		TextureCompression compression;
+		bool srgb;
+		groupFormat(group, compression, srgb);
+		if (compression != TEXTURE_UNCOMPRESSED)
+			return compressedFormat(compression, srgb);
+		return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+
+	// ------------------------------------------------------------------------
+	void buildLayers(const std::vector<size_t> &group)
+	{
+		TextureCompression compression;
+		bool srgb;
+		groupFormat(group, compression, srgb);
+		const TextureOptions &options = images[group[0]].options;
+		// baked layers are used in place; the others are baked here and kept until the upload
+		std::vector<CompressedImage> made;
+		made.reserve(group.size());
+		std::vector<LayerLevels> layers;
+		std::vector<unsigned char> rgba;
+		size_t levelCount = 32;
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			const Image &image = images[group[i]];
+			LayerLevels layer;
+			if (image.baked)
+			{
+				layer.data = image.baked->data();
+				layer.levels = &image.baked->levels;
+				stats.baked++;
+			}
+			else
+			{
+				rgba.resize((size_t)image.width * image.height * 4);
+				expandToRgba(image.pixels, (size_t)image.width * image.height, image.channels, rgba.data());
+				made.push_back(bakeImage(rgba.data(), image.width, image.height, 4, compression, srgb, options.mipFilter));
+				layer.data = made.back().data.data();
+				layer.levels = &made.back().levels;
+			}
+			// every layer has the same size, but a baked file may stop short of the 1x1 level
+			levelCount = std::min(levelCount, layer.levels->size());
+			layers.push_back(layer);
+		}
+		GLuint texture = uploadArray(layers, groupInternalFormat(group), compression != TEXTURE_UNCOMPRESSED, levelCount, options.wrap, options.minFilter, options.magFilter);
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			TextureRegion &region = images[group[i]].region;
+			region.texture = texture;
+			region.layer = (float)i;
+		}
+	}
+
+	// Shelf packer: tallest images first, left to right along a shelf as high as its first image, a new
+	// shelf when the row is full and a new page when the page is. Cells start on atlasGutter boundaries,
+	// so the mip levels that are kept never average texels from two cells.
+	// ------------------------------------------------------------------------
+	void buildAtlas(std::vector<size_t> group)
+	{
+		std::sort(group.begin(), group.end(), [this](size_t a, size_t b)
+		{
+			return images[a].height != images[b].height ? images[a].height > images[b].height : images[a].width > images[b].width;
+		});
+		TextureCompression compression;
+		bool srgb;
+		groupFormat(group, compression, srgb);
+		const TextureOptions &options = images[group[0]].options;
+		const int gutter = atlasGutter, size = atlasSize;
+
+		std::vector<std::vector<unsigned char> > pages;
+		int x = 0, y = 0, shelfHeight = 0;
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			Image &image = images[group[i]];
+			int cellWidth = align(image.width + 2 * gutter), cellHeight = align(image.height + 2 * gutter);
+			if (x + cellWidth > size)
+			{
+				x = 0;
+				y += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (pages.empty() || y + cellHeight > size)
+			{
+				pages.push_back(std::vector<unsigned char>((size_t)size * size * 4, 0));
+				x = y = shelfHeight = 0;
+			}
+			blit(image, pages.back().data(), x, y);
+			image.region.layer = (float)(pages.size() - 1);
+			image.region.rect = glm::vec4((float)(x + gutter) / size, (float)(y + gutter) / size, (float)image.width / size, (float)image.height / size);
+			x += cellWidth;
+			shelfHeight = std::max(shelfHeight, cellHeight);
+		}
+
+		std::vector<CompressedImage> made;
+		std::vector<LayerLevels> layers;
+		made.reserve(pages.size());
+		for (size_t p = 0; p < pages.size(); p++)
+		{
+			made.push_back(bakeImage(pages[p].data(), size, size, 4, compression, srgb, MIP_FILTER_BOX));
+			std::vector<unsigned char>().swap(pages[p]);
+			LayerLevels layer = { made.back().data.data(), &made.back().levels };
+			layers.push_back(layer);
+		}
+		// a level is kept while cell boundaries (multiples of the gutter at level 0) stay whole texels, or for
+		// block formats whole 4x4 blocks, so no texel or block covers two images
+		const int granularity = compression != TEXTURE_UNCOMPRESSED ? 4 : 1;
+		size_t levels = 1;
+		while ((gutter >> levels) >= granularity && levels < made[0].levels.size())
+			levels++;
+		// the shader wraps atlas coordinates itself, so the page edges clamp
+		GLuint texture = uploadArray(layers, made[0].format, compression != TEXTURE_UNCOMPRESSED, levels, GL_CLAMP_TO_EDGE, options.minFilter, options.magFilter);
+		for (size_t i = 0; i < group.size(); i++)
+			images[group[i]].region.texture = texture;
+		stats.atlasPages += (unsigned int)pages.size();
+		stats.atlasImages += (unsigned int)group.size();
+	}
+
+	int align(int value) const
+	{
+		return (value + atlasGutter - 1) & ~(atlasGutter - 1);
+	}
+
+	// copies an image into its cell with the gutter around it, wrapped for GL_REPEAT and clamped otherwise
+	// ------------------------------------------------------------------------
+	void blit(const Image &image, unsigned char *page, int cellX, int cellY) const
+	{
+		const int gutter = atlasGutter;
+		bool repeat = image.options.wrap == GL_REPEAT;
+		std::vector<unsigned char> row((size_t)(image.width + 2 * gutter) * image.channels);
+		for (int py = 0; py < image.height + 2 * gutter; py++)
+		{
+			int sy = py - gutter;
+			sy = repeat ? ((sy % image.height) + image.height) % image.height : std::min(std::max(sy, 0), image.height - 1);
+			const unsigned char *source = image.pixels + (size_t)sy * image.width * image.channels;
+			for (int px = 0; px < image.width + 2 * gutter; px++)
+			{
+				int sx = px - gutter;
+				sx = repeat ? ((sx % image.width) + image.width) % image.width : std::min(std::max(sx, 0), image.width - 1);
+				std::copy(source + (size_t)sx * image.channels, source + (size_t)(sx + 1) * image.channels, &row[(size_t)px * image.channels]);
+			}
+			expandToRgba(row.data(), (size_t)(image.width + 2 * gutter), image.channels, page + ((size_t)(cellY + py) * atlasSize + cellX) * 4);
+		}
+	}
+
+	// Allocates an array with one layer per image and the first levelCount levels of each, all in `format`
+	// (blocks when compressed, RGBA8 rows otherwise), and uploads them from client memory.
+	// ------------------------------------------------------------------------
+	GLuint uploadArray(const std::vector<LayerLevels> &layers, GLenum format, bool compressed, size_t levelCount, GLenum wrap, GLenum minFilter, GLenum magFilter)
+	{
+		const std::vector<CompressedLevel> &first = *layers[0].levels;
+		GLsizei depth = (GLsizei)layers.size();
+		GLuint texture;
+		glGenTextures(1, &texture);
+		GLState::get().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+		for (size_t l = 0; l < levelCount; l++)
+		{
+			const CompressedLevel &level = first[l];
+			if (compressed)
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, format, level.width, level.height, depth, 0, (GLsizei)(level.size * depth), nullptr);
+			else
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, format, level.width, level.height, depth, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			for (GLsizei layer = 0; layer < depth; layer++)
+			{
+				const CompressedLevel &part = (*layers[layer].levels)[l];
+				const unsigned char *data = layers[layer].data + part.offset;
+				if (compressed)
+					glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, 0, 0, layer, part.width, part.height, 1, format, (GLsizei)part.size, data);
+				else
+					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, 0, 0, layer, part.width, part.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+				stats.bytes += part.size;
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magFilter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+		textures.push_back(texture);
+		stats.arrays++;
+		stats.layers += (unsigned int)depth;
+		return texture;
+	}
+};
+#endif
\ No newline at end of file
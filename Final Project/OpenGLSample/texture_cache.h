@@ -0,0 +1,130 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "canonical_path.h"
+#include "gl_state.h"
+#include "stb_image.h"
+#include "texture_loader.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+struct TextureCacheStats
+{
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	// textures currently held, and their size with a full mip chain (from the image headers, at the
+	// decoded channel count or block size; drivers may pad RGB to RGBA)
+	unsigned int resident = 0;
+	unsigned long long residentBytes = 0;
+};
+
+// Process-wide texture cache: one GL texture per canonical path and TextureOptions, shared by every mesh
+// and call site that asks for it. acquire() adds a reference and release() drops one; the texture is
+// deleted with the last. Misses go through TextureLoader, so they return at once with a placeholder.
+class TextureCache
+{
+public:
+	static TextureCache &get()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	TextureCacheStats stats;
+
+	// 0 when the file cannot be read or is not an image stb can decode
+	// ------------------------------------------------------------------------
+	GLuint acquire(const char *path, const TextureOptions &options = TextureOptions())
+	{
+		Key key(canonicalPath(path), options);
+		std::map<Key, Entry>::iterator found = entries.find(key);
+		if (found != entries.end())
+		{
+			stats.hits++;
+			found->second.references++;
+			return found->second.texture;
+		}
+		stats.misses++;
+
+		// the header is enough to reject bad files and to size the entry; the decode happens on a worker
+		int width, height, channels;
+		if (!stbi_info(path, &width, &height, &channels))
+		{
+			std::cout << "ERROR::TEXTURE::LOAD_FAILED: " << path << " (" << stbi_failure_reason() << ")" << std::endl;
+			return 0;
+		}
+		Entry entry;
+		entry.texture = TextureLoader::get().load(path, options);
+		TextureCompression compression = resolveCompression(supportedCompression(options.compression, options.srgb), channels);
+		if (compression == TEXTURE_UNCOMPRESSED)
+			// CPU-built mip chains are uploaded as RGBA8
+			entry.bytes = (unsigned long long)width * height * (TextureLoader::get().cpuMipmaps ? 4 : channels) * 4 / 3;
+		else
+			entry.bytes = compressedImageBytes(width, height, compression);
+		entries.insert(std::make_pair(key, entry));
+		keys.insert(std::make_pair(entry.texture, key));
+		stats.resident++;
+		stats.residentBytes += entry.bytes;
+		return entry.texture;
+	}
+
+	// ------------------------------------------------------------------------
+	void release(GLuint texture)
+	{
+		std::map<GLuint, Key>::iterator key = keys.find(texture);
+		if (key == keys.end())
+			return;
+		std::map<Key, Entry>::iterator entry = entries.find(key->second);
+		if (--entry->second.references > 0)
+			return;
+		destroy(entry->second);
+		entries.erase(entry);
+		keys.erase(key);
+	}
+
+	// deletes every texture regardless of references; call before the context goes away
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		for (std::map<Key, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+			destroy(it->second);
+		entries.clear();
+		keys.clear();
+	}
+
+	void printStats(std::ostream &out) const
+	{
+		out << "Texture cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.resident << " resident ("
+			<< stats.residentBytes / (1024 * 1024) << " MB)" << std::endl;
+	}
+
+private:
+	typedef std::pair<std::string, TextureOptions> Key;
+
+	struct Entry
+	{
+		GLuint texture = 0;
+		unsigned int references = 1;
+		unsigned long long bytes = 0;
+	};
+
+	std::map<Key, Entry> entries;
+	std::map<GLuint, Key> keys;
+
+	TextureCache() {}
+
+	void destroy(const Entry &entry)
+	{
+		TextureLoader::get().discard(entry.texture);
+		GLState::get().forgetTexture(entry.texture);
+		glDeleteTextures(1, &entry.texture);
+		stats.resident--;
+		stats.residentBytes -= entry.bytes;
+	}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,387 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "baked_texture.h"
+#include "block_compression.h"
+#include "gl_state.h"
+#include "image_flip.h"
+#include "mpsc_queue.h"
+#include "pixel_upload_ring.h"
+#include "stb_image.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+
+// how a texture is oriented, sampled and stored; part of the TextureCache key
+struct TextureOptions
+{
+	ImageFlip flip = IMAGE_FLIP_ROWS;
+	GLenum wrap = GL_REPEAT;
+	GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLenum magFilter = GL_LINEAR;
+	// colour data stored as sRGB so sampling linearizes it; leave off for normal, specular and data maps
+	bool srgb = false;
+	// encode to a GPU block format on the workers (with CPU-built mips) instead of uploading RGBA8; formats
+	// the driver lacks fall back to uncompressed (supportedCompression)
+	TextureCompression compression = TEXTURE_UNCOMPRESSED;
+	// filter for the mip levels built on the CPU (compressed textures, and uncompressed ones with
+	// TextureLoader::cpuMipmaps); glGenerateMipmap always uses its own
+	MipFilter mipFilter = MIP_FILTER_BOX;
+
+	bool operator<(const TextureOptions &other) const
+	{
+		if (flip != other.flip) return flip < other.flip;
+		if (wrap != other.wrap) return wrap < other.wrap;
+		if (minFilter != other.minFilter) return minFilter < other.minFilter;
+		if (magFilter != other.magFilter) return magFilter < other.magFilter;
+		if (srgb != other.srgb) return srgb < other.srgb;
+		if (compression != other.compression) return compression < other.compression;
+		return mipFilter < other.mipFilter;
+	}
+};
+
+// what the loader has done so far
+struct TextureLoaderStats
+{
+	unsigned int requested = 0;
+	unsigned int uploaded = 0;
+	unsigned int failed = 0;
+	// of the uploaded ones, how many came from a baked file rather than a decode
+	unsigned int baked = 0;
+	unsigned long long bytesUploaded = 0;
+	double uploadMilliseconds = 0.0;
+	// longest time a single update() spent uploading
+	double worstFrameMilliseconds = 0.0;
+};
+
+// Why stbi_load failed, for decodes on worker threads. stbi_failure_reason() reads a single static that is
+// only thread-local when the stb implementation is compiled with STBI_THREAD_LOCAL, so concurrent workers
+// could report each other's reason; this only tells a missing file from one stb cannot decode.
+inline const char *imageLoadFailure(const std::string &path)
+{
+	FILE *file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return "cannot open file";
+	std::fclose(file);
+	return "unsupported or corrupt image";
+}
+
+// Loads PNG/JPEG textures off the render thread. load() returns a texture name at once, holding a 1x1 grey
+// placeholder; the file is decoded (and flipped) by a ThreadPool worker and the pixels come back to the
+// render thread through a lock-free queue, where update() uploads as many as fit in its time budget.
+// Compressed textures are block-encoded on the workers as well, a chunk of block rows per task, and
+// uncompressed ones get their mip chain there too (cpuMipmaps) instead of from glGenerateMipmap. An
+// up-to-date baked file (<image>.gstx, see baked_texture.h) is mapped and uploaded instead of all that.
+// Callers keep the same texture name throughout, so meshes can bind it immediately.
+class TextureLoader
+{
+public:
+	static TextureLoader &get()
+	{
+		static TextureLoader loader;
+		return loader;
+	}
+
+	TextureLoaderStats stats;
+	// stream uploads through PixelUploadRing instead of glTexImage2D from client memory
+	bool pixelBuffers = true;
+	// use <image>.gstx when it matches the options and is not older than the image
+	bool bakedTextures = true;
+	// build uncompressed mip chains on the workers (gamma-correct for sRGB, with TextureOptions::mipFilter)
+	// rather than with glGenerateMipmap, which filters sRGB in gamma space on some drivers and can stall
+	bool cpuMipmaps = true;
+	PixelUploadRing uploadRing;
+
+	// render thread only
+	// ------------------------------------------------------------------------
+	GLuint load(const char *path, const TextureOptions &options = TextureOptions())
+	{
+		GLuint texture = createPlaceholder(options);
+		stats.requested++;
+		inFlight.fetch_add(1, std::memory_order_relaxed);
+		unsigned long long ticket = ++nextTicket;
+		waiting[texture] = ticket;
+		std::string file = path;
+		ImageFlip flip = options.flip;
+		bool srgb = options.srgb;
+		TextureCompression compression = supportedCompression(options.compression, srgb);
+		MipFilter filter = options.mipFilter;
+		bool tryBaked = bakedTextures, mipmaps = cpuMipmaps;
+		MpscQueue<DecodedImage> *results = &decoded;
+		ThreadPool::shared().submit([texture, ticket, file, flip, srgb, compression, filter, tryBaked, mipmaps, results]()
+		{
+			DecodedImage image;
+			image.texture = texture;
+			image.ticket = ticket;
+			image.path = file;
+			image.srgb = srgb;
+			if (tryBaked)
+			{
+				image.baked = openBakedTexture(file, flip, compression, srgb, filter);
+				if (image.baked)
+				{
+					results->push(std::move(image));
+					return;
+				}
+			}
+			// the global stbi flip flag is shared by every thread, so workers use the per-thread one
+			stbi_set_flip_vertically_on_load_thread(flip == IMAGE_FLIP_IN_DECODER);
+			image.pixels = stbi_load(file.c_str(), &image.width, &image.height, &image.channels, 0);
+			if (image.pixels == nullptr)
+				image.error = imageLoadFailure(file);
+			else if (flip == IMAGE_FLIP_ROWS)
+				flipImageVertically(image.pixels, image.width, image.height, image.channels);
+			if (image.pixels != nullptr && compression != TEXTURE_UNCOMPRESSED)
+			{
+				compress(image, compression, filter, results);
+				return;
+			}
+			if (image.pixels != nullptr && mipmaps)
+			{
+				image.compressed = uncompressedMipImage(image.pixels, image.width, image.height, image.channels, srgb, filter);
+				stbi_image_free(image.pixels);
+				image.pixels = nullptr;
+			}
+			results->push(std::move(image));
+		});
+		return texture;
+	}
+
+	// Uploads finished images until budgetMilliseconds have passed; at least one per call, so a large
+	// image cannot stall the queue. Call once per frame from the render thread.
+	// ------------------------------------------------------------------------
+	void update(double budgetMilliseconds = 2.0)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double elapsed = 0.0;
+		DecodedImage image;
+		while (elapsed < budgetMilliseconds && decoded.pop(image))
+		{
+			upload(image);
+			inFlight.fetch_sub(1, std::memory_order_relaxed);
+			elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		if (pixelBuffers)
+			uploadRing.endFrame();
+		stats.uploadMilliseconds += elapsed;
+		if (elapsed > stats.worstFrameMilliseconds)
+			stats.worstFrameMilliseconds = elapsed;
+	}
+
+	// Call before deleting a texture from load(): if its image is still on the way, it is dropped instead of
+	// being uploaded into a deleted name. A later load() that gets the same name back from GL hands out a
+	// new ticket, so the old image is dropped then too.
+	void discard(GLuint texture)
+	{
+		waiting.erase(texture);
+	}
+
+	// textures still showing their placeholder
+	unsigned int pending() const
+	{
+		return inFlight.load(std::memory_order_relaxed);
+	}
+
+	void printStats(std::ostream &out) const
+	{
+		out << "Texture loader: " << stats.uploaded << " / " << stats.requested << " uploaded (" << stats.baked << " baked, " << stats.failed << " failed, "
+			<< pending() << " pending), " << stats.bytesUploaded / (1024 * 1024) << " MB in " << stats.uploadMilliseconds
+			<< " ms, worst frame " << stats.worstFrameMilliseconds << " ms" << std::endl;
+		if (pixelBuffers)
+			uploadRing.printStats(out);
+	}
+
+	// releases the upload buffers; textures already handed out stay with their owners
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		uploadRing.release();
+	}
+
+private:
+	struct DecodedImage
+	{
+		GLuint texture = 0;
+		// which load() of `texture` this image answers; GL reuses deleted names
+		unsigned long long ticket = 0;
+		std::string path;
+		unsigned char *pixels = nullptr;
+		const char *error = nullptr;
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		bool srgb = false;
+		// set instead of pixels for block-compressed textures and CPU-built (RGBA8) mip chains
+		CompressedImage compressed;
+		// or instead of both, a mapped file holding every level
+		std::shared_ptr<BakedTextureFile> baked;
+	};
+
+	MpscQueue<DecodedImage> decoded;
+	std::atomic<unsigned int> inFlight;
+	// textures whose image has not been uploaded yet and are still wanted, with the ticket of the load()
+	// they are waiting for; render thread only
+	std::map<GLuint, unsigned long long> waiting;
+	unsigned long long nextTicket = 0;
+
+	TextureLoader() : inFlight(0) {}
+
+	// ------------------------------------------------------------------------
+	static GLuint createPlaceholder(const TextureOptions &options)
+	{
+		static const unsigned char grey[4] = { 128, 128, 128, 255 };
+		GLuint texture;
+		glGenTextures(1, &texture);
+		GLState::get().bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, options.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, options.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, options.minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, options.magFilter);
+		return texture;
+	}
+
+	// Runs on a worker: builds the mips, then queues the block rows as separate pool tasks. The task that
+	// finishes last queues the image for upload, so none of them waits on another.
+	// ------------------------------------------------------------------------
+	static void compress(DecodedImage &image, TextureCompression compression, MipFilter filter, MpscQueue<DecodedImage> *results)
+	{
+		std::shared_ptr<BlockCompressionJob> job(new BlockCompressionJob(image.pixels, image.width, image.height, image.channels, compression, image.srgb, filter));
+		stbi_image_free(image.pixels);
+		image.pixels = nullptr;
+		GLuint texture = image.texture;
+		unsigned long long ticket = image.ticket;
+		std::string path = image.path;
+		for (size_t chunk = 0; chunk < job->chunkCount(); chunk++)
+			ThreadPool::shared().submit([job, chunk, texture, ticket, path, results]()
+			{
+				if (!job->encodeChunk(chunk))
+					return;
+				DecodedImage done;
+				done.texture = texture;
+				done.ticket = ticket;
+				done.path = path;
+				done.width = job->image.levels[0].width;
+				done.height = job->image.levels[0].height;
+				done.compressed = std::move(job->image);
+				results->push(std::move(done));
+			});
+	}
+
+	// Specifies every level of the bound texture from `data`: blocks for the compressed formats, RGBA8 rows
+	// for TEXTURE_UNCOMPRESSED. Through the ring that is a single copy into one slot, however many levels.
+	// ------------------------------------------------------------------------
+	void uploadLevels(TextureCompression compression, GLenum internalFormat, const unsigned char *data, size_t bytes, const std::vector<CompressedLevel> &levels)
+	{
+		bool compressed = compression != TEXTURE_UNCOMPRESSED;
+		auto issue = [&](const unsigned char *source)
+		{
+			for (size_t l = 0; l < levels.size(); l++)
+			{
+				const CompressedLevel &level = levels[l];
+				if (compressed)
+					glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)l, 0, 0, level.width, level.height, internalFormat, (GLsizei)level.size, source + level.offset);
+				else
+					glTexSubImage2D(GL_TEXTURE_2D, (GLint)l, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, source + level.offset);
+			}
+		};
+		// a baked chain need not reach 1x1, and the texture is only mip-complete up to its last level
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+		// allocate every level first
+		for (size_t l = 0; l < levels.size(); l++)
+		{
+			const CompressedLevel &level = levels[l];
+			if (compressed)
+				glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, (GLsizei)level.size, nullptr);
+			else
+				glTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+		if (pixelBuffers)
+			uploadRing.stream(data, bytes, issue);
+		else
+			issue(data);
+		stats.uploaded++;
+		stats.bytesUploaded += bytes;
+	}
+
+	// ------------------------------------------------------------------------
+	void upload(DecodedImage &image)
+	{
+		std::map<GLuint, unsigned long long>::iterator wanted = waiting.find(image.texture);
+		if (wanted == waiting.end() || wanted->second != image.ticket)
+		{
+			stbi_image_free(image.pixels);
+			image.pixels = nullptr;
+			image.compressed = CompressedImage();
+			image.baked.reset();
+			return;
+		}
+		waiting.erase(wanted);
+		if (image.baked)
+		{
+			const BakedTextureFile &baked = *image.baked;
+			GLState::get().bindTexture(0, GL_TEXTURE_2D, image.texture);
+			// the levels sit back to back after the level table
+			size_t first = baked.levels.front().offset;
+			size_t end = baked.levels.back().offset + baked.levels.back().size;
+			std::vector<CompressedLevel> levels = baked.levels;
+			for (size_t l = 0; l < levels.size(); l++)
+				levels[l].offset -= first;
+			uploadLevels((TextureCompression)baked.header->compression, baked.internalFormat, baked.data() + first, end - first, levels);
+			stats.baked++;
+			image.baked.reset();
+			return;
+		}
+		if (!image.compressed.levels.empty())
+		{
+			GLState::get().bindTexture(0, GL_TEXTURE_2D, image.texture);
+			uploadLevels(image.compressed.compression, image.compressed.format, image.compressed.data.data(), image.compressed.data.size(), image.compressed.levels);
+			image.compressed = CompressedImage();
+			return;
+		}
+		if (image.pixels == nullptr)
+		{
+			std::cout << "ERROR::TEXTURE::LOAD_FAILED: " << image.path << " (" << image.error << ")" << std::endl;
+			stats.failed++;
+			return;
+		}
+		static const GLenum formats[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		static const GLenum internalFormats[2][5] = { { 0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 }, { 0, GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8 } };
+		GLenum internalFormat = internalFormats[image.srgb ? 1 : 0][image.channels];
+		GLState::get().bindTexture(0, GL_TEXTURE_2D, image.texture);
+		size_t bytes = (size_t)image.width * image.height * image.channels;
+		if (pixelBuffers)
+		{
+			// allocate only; the pixels follow from the ring's buffer
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, formats[image.channels], GL_UNSIGNED_BYTE, nullptr);
+			uploadRing.upload(0, image.width, image.height, formats[image.channels], image.pixels, bytes);
+		}
+		else
+		{
+			// rows of 1-3 channel images are not 4-byte aligned
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, formats[image.channels], GL_UNSIGNED_BYTE, image.pixels);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+		// stb's 1 and 2 channel images are grey and grey + alpha, not red and red-green
+		if (image.channels <= 2)
+		{
+			static const GLint swizzles[2][4] = { { GL_RED, GL_RED, GL_RED, GL_ONE }, { GL_RED, GL_RED, GL_RED, GL_GREEN } };
+			glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzles[image.channels - 1]);
+		}
+		glGenerateMipmap(GL_TEXTURE_2D);
+		stats.uploaded++;
+		stats.bytesUploaded += bytes;
+		stbi_image_free(image.pixels);
+		image.pixels = nullptr;
+	}
+};
+#endif
\ No newline at end of file
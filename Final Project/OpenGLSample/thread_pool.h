@@ -0,0 +1,122 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads fed from one queue. Tasks must not touch OpenGL (the context belongs to the
+// render thread) and must not wait on other tasks of the same pool, or a full pool can deadlock.
+class ThreadPool
+{
+public:
+	// 0 = one worker per hardware thread, leaving one for the render thread
+	explicit ThreadPool(unsigned int threads = 0)
+	{
+		if (threads == 0)
+		{
+			unsigned int hardware = std::thread::hardware_concurrency();
+			threads = hardware > 1 ? hardware - 1 : 1;
+		}
+		for (unsigned int i = 0; i < threads; i++)
+			workers.push_back(std::thread(&ThreadPool::run, this));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// pool shared by the asset loaders
+	static ThreadPool &shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	unsigned int size() const
+	{
+		return (unsigned int)workers.size();
+	}
+
+	// queue a task; the future carries its result or exception
+	template <typename F>
+	auto submit(F task) -> std::future<decltype(task())>
+	{
+		typedef decltype(task()) Result;
+		std::shared_ptr<std::packaged_task<Result()> > packaged(new std::packaged_task<Result()>(task));
+		std::future<Result> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back([packaged]() { (*packaged)(); });
+		}
+		wake.notify_one();
+		return result;
+	}
+
+	// run body(i) for every i in [0, count) on the workers and wait for all of them, then rethrow the
+	// first exception any of them threw; call from outside the pool only
+	void parallelFor(size_t count, const std::function<void(size_t)> &body)
+	{
+		std::vector<std::future<void> > pending;
+		pending.reserve(count);
+		for (size_t i = 0; i < count; i++)
+			pending.push_back(submit([&body, i]() { body(i); }));
+		// the tasks reference body, so every one of them has to finish before this returns or throws
+		std::exception_ptr failure;
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			try
+			{
+				pending[i].get();
+			}
+			catch (...)
+			{
+				if (!failure)
+					failure = std::current_exception();
+			}
+		}
+		if (failure)
+			std::rethrow_exception(failure);
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void run()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+				if (queue.empty())
+					return;
+				task = std::move(queue.front());
+				queue.pop_front();
+			}
+			task();
+		}
+	}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// one vertex attribute inside an interleaved vertex
+struct VertexAttribute
+{
+	GLuint location;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	unsigned int offset;
+};
+
+// how positions are stored in a packed vertex; half floats keep about three significant digits,
+// so POSITION_HALF suits props modelled within a few units of their origin
+enum VertexPositionType {
+	POSITION_FLOAT,
+	POSITION_HALF
+};
+
+// Describes an interleaved vertex layout: its size, its attribute pointers, and the defines a vertex
+// shader needs to read it. The packed layouts store normal and tangent as octahedral-encoded
+// GL_INT_2_10_10_10_REV (the tangent's w holds the bitangent sign) and UVs as half floats;
+// attribute 4 (bitangent) is absent and reads as (0, 0, 0, 1).
+struct VertexFormat
+{
+	const char *name;
+	bool packed;
+	VertexPositionType position;
+	unsigned int stride;
+	std::vector<VertexAttribute> attributes;
+	// e.g. "#define PACKED_NORMALS 1\n", for Shader's define injection
+	std::string defines;
+
+	// set the attribute pointers; call with the VAO and the vertex buffer bound
+	void setup() const
+	{
+		for (size_t i = 0; i < attributes.size(); i++)
+		{
+			const VertexAttribute &attribute = attributes[i];
+			glEnableVertexAttribArray(attribute.location);
+			glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, stride, (void*)(size_t)attribute.offset);
+		}
+	}
+
+	// the full float layout of Mesh's Vertex (56 bytes)
+	static const VertexFormat &full()
+	{
+		static const VertexFormat format = { "full", false, POSITION_FLOAT, 56, {
+			{ 0, 3, GL_FLOAT, GL_FALSE, 0 },
+			{ 1, 3, GL_FLOAT, GL_FALSE, 12 },
+			{ 2, 2, GL_FLOAT, GL_FALSE, 24 },
+			{ 3, 3, GL_FLOAT, GL_FALSE, 32 },
+			{ 4, 3, GL_FLOAT, GL_FALSE, 44 } }, "" };
+		return format;
+	}
+	// float position, packed normal/tangent/UV (24 bytes)
+	static const VertexFormat &packedFloat()
+	{
+		static const VertexFormat format = { "packed", true, POSITION_FLOAT, 24, {
+			{ 0, 3, GL_FLOAT, GL_FALSE, 0 },
+			{ 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 12 },
+			{ 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 16 },
+			{ 2, 2, GL_HALF_FLOAT, GL_FALSE, 20 } }, "#define PACKED_NORMALS 1\n" };
+		return format;
+	}
+	// half position (padded to 8 bytes), packed normal/tangent/UV (20 bytes)
+	static const VertexFormat &packedHalf()
+	{
+		static const VertexFormat format = { "packed-half", true, POSITION_HALF, 20, {
+			{ 0, 3, GL_HALF_FLOAT, GL_FALSE, 0 },
+			{ 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8 },
+			{ 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 12 },
+			{ 2, 2, GL_HALF_FLOAT, GL_FALSE, 16 } }, "#define PACKED_NORMALS 1\n" };
+		return format;
+	}
+	// look a format up by its name (as stored in mesh cache files); nullptr if unknown
+	static const VertexFormat *byName(const std::string &name)
+	{
+		const VertexFormat *formats[] = { &full(), &packedFloat(), &packedHalf() };
+		for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+			if (name == formats[i]->name)
+				return formats[i];
+		return nullptr;
+	}
+};
+
+// float -> IEEE half, round to nearest even; overflow becomes infinity, tiny values flush through the subnormals
+inline unsigned short packHalf(float value)
+{
+	unsigned int bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000u;
+	unsigned int exponent = (bits >> 23) & 0xffu;
+	unsigned int mantissa = bits & 0x7fffffu;
+
+	if (exponent == 0xffu)
+		return (unsigned short)(sign | 0x7c00u | (mantissa ? 0x200u : 0u)); // inf / nan
+	int halfExponent = (int)exponent - 127 + 15;
+	if (halfExponent >= 0x1f)
+		return (unsigned short)(sign | 0x7c00u);
+	if (halfExponent <= 0)
+	{
+		if (halfExponent < -10)
+			return (unsigned short)sign;
+		// subnormal: shift the mantissa (with its implicit leading one) into place
+		mantissa |= 0x800000u;
+		unsigned int shift = (unsigned int)(14 - halfExponent);
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1u);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1u)))
+			half++;
+		return (unsigned short)(sign | half);
+	}
+	unsigned int half = ((unsigned int)halfExponent << 10) | (mantissa >> 13);
+	unsigned int rest = mantissa & 0x1fffu;
+	// a carry out of the mantissa correctly bumps the exponent
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+		half++;
+	return (unsigned short)(sign | half);
+}
+
+// unit vector -> point in [-1, 1]^2 on the unfolded octahedron
+inline glm::vec2 octEncode(const glm::vec3 &n)
+{
+	float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (sum == 0.0f)
+		return glm::vec2(0.0f, 0.0f);
+	float x = n.x / sum;
+	float y = n.y / sum;
+	if (n.z < 0.0f)
+	{
+		// fold the lower hemisphere over the diagonals
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	return glm::vec2(x, y);
+}
+
+// four signed normalized values -> GL_INT_2_10_10_10_REV (x in the low bits, w in the top two)
+inline unsigned int packSnorm2_10_10_10(float x, float y, float z, float w)
+{
+	int ix = (int)std::floor((x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x)) * 511.0f + 0.5f);
+	int iy = (int)std::floor((y < -1.0f ? -1.0f : (y > 1.0f ? 1.0f : y)) * 511.0f + 0.5f);
+	int iz = (int)std::floor((z < -1.0f ? -1.0f : (z > 1.0f ? 1.0f : z)) * 511.0f + 0.5f);
+	int iw = w < 0.0f ? -1 : 1;
+	return ((unsigned int)ix & 0x3ffu) | (((unsigned int)iy & 0x3ffu) << 10) | (((unsigned int)iz & 0x3ffu) << 20) | (((unsigned int)iw & 0x3u) << 30);
+}
+#endif
\ No newline at end of file